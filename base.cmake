@@ -15,8 +15,10 @@ macro(rg_setup_compile_options)
         component_compile_options(-DRG_ENABLE_NETWORKING)
     endif()
 
-    if(RG_ENABLE_PROFILING)
-        # Still debating whether -fno-inline is necessary or not...
-        component_compile_options(-DRG_ENABLE_PROFILING -finstrument-functions)
+    if(RG_ENABLE_PROFILING EQUAL 2)
+        # Instrumented mode, exact call counts at the cost of a hook around every function call
+        component_compile_options(-DRG_ENABLE_PROFILING=2 -finstrument-functions)
+    elseif(RG_ENABLE_PROFILING)
+        component_compile_options(-DRG_ENABLE_PROFILING)
     endif()
 endmacro()
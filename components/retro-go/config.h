@@ -144,3 +144,89 @@
 #ifndef RG_SCREEN_PARTIAL_UPDATES
 #define RG_SCREEN_PARTIAL_UPDATES 1
 #endif
+
+#ifndef RG_SCREEN_PARALLEL_RENDER
+#define RG_SCREEN_PARALLEL_RENDER 0 // Render every other block of lines on a second task (on the other core)
+#endif
+
+#ifndef RG_SCREEN_VSYNC
+#define RG_SCREEN_VSYNC 1 // SDL2 only: 0 presents frames as fast as possible, for benchmarking
+#endif
+
+// Those are used by the recording display driver (RG_SCREEN_DRIVER 98)
+#ifndef RG_SCREEN_FILE_PATH
+#define RG_SCREEN_FILE_PATH "frames.log"
+#endif
+
+#ifndef RG_SCREEN_FILE_FORMAT
+#define RG_SCREEN_FILE_FORMAT 0 // 0 = Hash log, 1 = Raw RGB565 LE, 2 = Y4M
+#endif
+
+#ifndef RG_SCREEN_FILE_INTERVAL
+#define RG_SCREEN_FILE_INTERVAL 1 // Record one frame out of N
+#endif
+
+#ifndef RG_GUI_NOTIFICATION_TIME
+#define RG_GUI_NOTIFICATION_TIME 2000000 // Microseconds a rg_gui_show_notification() message stays on screen
+#endif
+
+#ifndef RG_FRAMESKIP_MAX
+#define RG_FRAMESKIP_MAX 5 // Upper bound of the auto frameskip
+#endif
+
+#ifndef RG_FRAMESKIP_BUDGET
+#define RG_FRAMESKIP_BUDGET 0.9f // Share of the frame time the predicted work may use, the rest absorbs jitter
+#endif
+
+#ifndef RG_REWIND_BUDGET
+#define RG_REWIND_BUDGET 0 // Default rewind budget in KB, 0 = off
+#endif
+
+#ifndef RG_REWIND_INTERVAL
+#define RG_REWIND_INTERVAL 6 // Frames between snapshots, rewinding plays back at this many times the speed
+#endif
+
+#ifndef RG_REWIND_KEY
+#define RG_REWIND_KEY RG_KEY_L // Hold to rewind, targets without L can pick another key or leave it to rg_emu_rewind()
+#endif
+
+#ifndef RG_RUN_AHEAD
+#define RG_RUN_AHEAD 1 // Default run-ahead frames, for the cores that support it
+#endif
+
+#ifndef RG_RUN_AHEAD_MAX
+#define RG_RUN_AHEAD_MAX 3
+#endif
+
+#ifndef RG_PROFILE_RATE
+#define RG_PROFILE_RATE 250 // Samples per second of the host's profiler, the ESP32 samples on every FreeRTOS tick
+#endif
+
+#ifndef RG_PROFILE_DUMP_INTERVAL
+#define RG_PROFILE_DUMP_INTERVAL 10 // Seconds between RGD:PROF dumps, 0 to only dump on request
+#endif
+
+#ifndef RG_BENCHMARK_FRAMES
+#define RG_BENCHMARK_FRAMES 0 // Host only: run that many frames unthrottled, print FPS, frame times and memory, then exit
+#endif
+
+#ifndef RG_TRACE_BUFFER_LENGTH
+#define RG_TRACE_BUFFER_LENGTH 4096 // Timeline markers kept for rg_system_save_trace(), must be a power of two (0 disables)
+#endif
+
+#ifndef RG_AUDIO_BUFFER_LENGTH
+#define RG_AUDIO_BUFFER_LENGTH 1024 // Frames queued between the emulator and the audio task, must be a power of two
+#endif
+
+#ifndef RG_AUDIO_RATE_CONTROL
+#define RG_AUDIO_RATE_CONTROL 0.005f // Maximum resampling adjustment used to keep that buffer half full (0 disables)
+#endif
+
+// Those are used by the recording audio sink (RG_AUDIO_USE_FILE)
+#ifndef RG_AUDIO_FILE_PATH
+#define RG_AUDIO_FILE_PATH "audio.wav"
+#endif
+
+#ifndef RG_AUDIO_FILE_FORMAT
+#define RG_AUDIO_FILE_FORMAT 0 // 0 = WAV, 1 = Raw PCM, 2 = CRC log
+#endif
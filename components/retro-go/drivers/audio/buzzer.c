@@ -86,6 +86,7 @@ Note that there are some restrictions on how high the PWM frequency can be, and
 // Global variables shared with interrupt handler:
 int underflows = 0;
 int overflows = 0;
+static int deviceSampleRate = 0;
 QueueHandle_t sampleQueue;
 
 // Global variables used for approximating rolling average of samples in sampleQueue:
@@ -173,6 +174,7 @@ static bool buzzer_init(int device, int sampleRate)
 
     underflows = 0;
     overflows = 0;
+    deviceSampleRate = sampleRate;
     int cacheSamples = (sampleRate/1000)*MS_OF_CACHED_SAMPLES;
 
 #ifdef PLAY_SINE_AS_TEST
@@ -312,9 +314,9 @@ static bool buzzer_deinit(void)
 
 static bool buzzer_submit(const rg_audio_frame_t *frames, size_t count)
 {
-    // FIXME: We should probably use globals here instead of doing three function calls per submission...
-    float volumeFactor = rg_audio_get_mute() ? 0.f : (rg_audio_get_volume() * 0.01f) * BOOSTVOLUME;
-    int sampleRate = rg_audio_get_sample_rate();
+    // Volume and mute were already applied by rg_audio
+    float volumeFactor = BOOSTVOLUME;
+    int sampleRate = deviceSampleRate;
 
     for (size_t i = 0; i < count; ++i)
     {
@@ -0,0 +1,134 @@
+#include "rg_system.h"
+#include "rg_audio.h"
+
+#if RG_AUDIO_USE_FILE
+#include <stdio.h>
+#include <string.h>
+
+// Headless sink that records to RG_AUDIO_FILE_PATH instead of playing. It doesn't pace anything, which is
+// the point when measuring how fast a core can generate audio.
+// RG_AUDIO_FILE_FORMAT: 0 = WAV, 1 = Raw PCM (S16LE stereo), 2 = One CRC per 1/60s of audio (for regression tests)
+
+#define BUFFER_LENGTH 4096
+
+static FILE *output;
+static rg_audio_frame_t buffer[BUFFER_LENGTH];
+static size_t buffered;
+static uint32_t dataSize;
+static int sampleRate;
+static uint32_t crc, crcFrames, crcIndex;
+static const char *last_error;
+
+static void write_wav_header(void)
+{
+    uint32_t header[11] = {
+        0x46464952, 36 + dataSize, 0x45564157,   // "RIFF", size, "WAVE"
+        0x20746D66, 16, 0x00020001, sampleRate,  // "fmt ", size, PCM + 2 channels, rate
+        sampleRate * 4, 0x00100004,              // byte rate, block align + 16 bits
+        0x61746164, dataSize,                    // "data", size
+    };
+    fseek(output, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, output);
+    fseek(output, 0, SEEK_END);
+}
+
+static void flush_buffer(void)
+{
+    if (!output || !buffered)
+        return;
+    fwrite(buffer, sizeof(rg_audio_frame_t), buffered, output);
+    dataSize += buffered * sizeof(rg_audio_frame_t);
+    buffered = 0;
+    // Keep the header up to date so the file stays playable if we never get to deinit (crash, reset)
+    if (RG_AUDIO_FILE_FORMAT == 0)
+        write_wav_header();
+    fflush(output);
+}
+
+static bool driver_init(int device, int _sampleRate)
+{
+    sampleRate = _sampleRate;
+    buffered = dataSize = 0;
+    crc = crcFrames = crcIndex = 0;
+    output = fopen(RG_AUDIO_FILE_PATH, "wb");
+    if (!output)
+    {
+        last_error = "Failed to open " RG_AUDIO_FILE_PATH;
+        return false;
+    }
+    if (RG_AUDIO_FILE_FORMAT == 0)
+        write_wav_header();
+    return true;
+}
+
+static bool driver_deinit(void)
+{
+    if (output)
+    {
+        flush_buffer();
+        fclose(output);
+    }
+    output = NULL;
+    return true;
+}
+
+static bool driver_submit(const rg_audio_frame_t *frames, size_t count)
+{
+    if (!output)
+        return false;
+
+    if (RG_AUDIO_FILE_FORMAT == 2)
+    {
+        // The blocks don't depend on how the frames were split between submissions
+        size_t block = RG_MAX(sampleRate / 60, 1);
+        while (count > 0)
+        {
+            size_t chunk = RG_MIN(count, block - crcFrames);
+            crc = rg_crc32(crc, (const uint8_t *)frames, chunk * sizeof(rg_audio_frame_t));
+            crcFrames += chunk;
+            frames += chunk;
+            count -= chunk;
+            if (crcFrames == block)
+            {
+                fprintf(output, "%u %08X\n", (unsigned)crcIndex++, (unsigned)crc);
+                crc = crcFrames = 0;
+            }
+        }
+        return true;
+    }
+
+    while (count > 0)
+    {
+        size_t chunk = RG_MIN(count, BUFFER_LENGTH - buffered);
+        memcpy(buffer + buffered, frames, chunk * sizeof(rg_audio_frame_t));
+        buffered += chunk;
+        frames += chunk;
+        count -= chunk;
+        if (buffered == BUFFER_LENGTH)
+            flush_buffer();
+    }
+
+    return true;
+}
+
+static bool driver_set_volume(int volume)
+{
+    // Recordings are kept as submitted, this also keeps rg_audio from applying the volume itself
+    return true;
+}
+
+static const char *driver_get_error(void)
+{
+    return last_error;
+}
+
+const rg_audio_driver_t rg_audio_driver_file = {
+    .name = "file",
+    .init = driver_init,
+    .deinit = driver_deinit,
+    .submit = driver_submit,
+    .set_volume = driver_set_volume,
+    .get_error = driver_get_error,
+};
+
+#endif // RG_AUDIO_USE_FILE
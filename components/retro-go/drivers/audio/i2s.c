@@ -15,9 +15,13 @@
 #include <driver/dac.h>
 #endif
 
+#define DMA_BUF_COUNT 4 // Goal is to have ~800 samples over 2-8 buffers (3x270 or 5x180 are pretty good)
+#define DMA_BUF_LEN 180 // The unit is stereo samples (4 bytes) (optimize for 533 usage)
+
 static struct {
     const char *last_error;
     int device;
+    int sample_rate;
     int volume;
     bool muted;
 } state;
@@ -26,6 +30,7 @@ static bool driver_init(int device, int sample_rate)
 {
     state.last_error = NULL;
     state.device = device;
+    state.sample_rate = sample_rate;
 
     if (state.device == 0)
     {
@@ -37,8 +42,8 @@ static bool driver_init(int device, int sample_rate)
             .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
             .communication_format = I2S_COMM_FORMAT_STAND_MSB,
             .intr_alloc_flags = 0, // ESP_INTR_FLAG_LEVEL1
-            .dma_buf_count = 4, // Goal is to have ~800 samples over 2-8 buffers (3x270 or 5x180 are pretty good)
-            .dma_buf_len = 180, // The unit is stereo samples (4 bytes) (optimize for 533 usage)
+            .dma_buf_count = DMA_BUF_COUNT,
+            .dma_buf_len = DMA_BUF_LEN,
         }, 0, NULL);
         if (ret == ESP_OK)
             ret = i2s_set_dac_mode(RG_AUDIO_USE_INT_DAC);
@@ -58,8 +63,8 @@ static bool driver_init(int device, int sample_rate)
             .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
             .communication_format = I2S_COMM_FORMAT_STAND_I2S,
             .intr_alloc_flags = 0, // ESP_INTR_FLAG_LEVEL1
-            .dma_buf_count = 4, // Goal is to have ~800 samples over 2-8 buffers (3x270 or 5x180 are pretty good)
-            .dma_buf_len = 180, // The unit is stereo samples (4 bytes) (optimize for 533 usage)
+            .dma_buf_count = DMA_BUF_COUNT,
+            .dma_buf_len = DMA_BUF_LEN,
         #if CONFIG_IDF_TARGET_ESP32
             .use_apll = true, // External DAC may care about accuracy
         #endif
@@ -85,6 +90,7 @@ static bool driver_init(int device, int sample_rate)
 
 static bool driver_set_sample_rates(int sampleRate)
 {
+    state.sample_rate = sampleRate;
     return i2s_set_sample_rates(I2S_NUM_0, sampleRate) == ESP_OK;
 }
 
@@ -200,6 +206,14 @@ static bool driver_set_volume(int volume)
     return true;
 }
 
+static bool driver_get_counters(rg_audio_counters_t *counters)
+{
+    // i2s_write blocks until there's room so, while playing, the DMA buffers are always close to full
+    counters->queuedSamples = DMA_BUF_COUNT * DMA_BUF_LEN;
+    counters->latency = (int64_t)counters->queuedSamples * 1000000 / state.sample_rate;
+    return true;
+}
+
 static const char *driver_get_error(void)
 {
     return state.last_error;
@@ -213,6 +227,7 @@ const rg_audio_driver_t rg_audio_driver_i2s = {
     .set_mute = driver_set_mute,
     .set_volume = driver_set_volume,
     .set_sample_rate = driver_set_sample_rates,
+    .get_counters = driver_get_counters,
     .get_error = driver_get_error,
 };
 
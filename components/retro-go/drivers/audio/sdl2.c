@@ -4,47 +4,148 @@
 #if RG_AUDIO_USE_SDL2
 #include <SDL2/SDL.h>
 
+// SDL pulls samples from this ring in its callback, and driver_submit blocks while it's full enough.
+// That way the pacing comes from the actual device clock.
+#define BUFFER_LENGTH 1024 // Must be a power of two
+#define DEVICE_SAMPLES 512
+
 static SDL_AudioDeviceID audioDevice;
 static int sampleRate;
+static int deviceSamples;
+static bool muted;
+
+static struct
+{
+    rg_audio_frame_t frames[BUFFER_LENGTH];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} ring;
+
+// marker* follows a single frame from driver_submit to the callback to measure the actual latency
+static struct
+{
+    volatile bool markerPending;
+    uint32_t markerPos;
+    int64_t markerTime;
+    volatile int32_t latency;
+    volatile uint32_t underruns;
+    bool starved;
+} stats;
+
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+    rg_audio_frame_t *out = (rg_audio_frame_t *)stream;
+    size_t needed = len / sizeof(rg_audio_frame_t);
+    uint32_t tail = ring.tail;
+    size_t count = RG_MIN(ring.head - tail, needed);
+
+    __sync_synchronize();
+    for (size_t i = 0; i < count; ++i)
+        out[i] = ring.frames[(tail + i) & (BUFFER_LENGTH - 1)];
+    __sync_synchronize();
+    ring.tail = tail + count;
+
+    if (count < needed)
+    {
+        memset(out + count, 0, (needed - count) * sizeof(rg_audio_frame_t));
+        // Only count the transitions, otherwise a paused emulator would look like a stream of underruns
+        if (!stats.starved)
+            stats.underruns++;
+        stats.starved = true;
+    }
+    else
+    {
+        stats.starved = false;
+    }
+
+    if (muted)
+        memset(stream, 0, len);
+
+    if (stats.markerPending && (int32_t)(ring.tail - stats.markerPos) >= 0)
+    {
+        // The marked frame was just handed to SDL, it will be heard once the device buffer drains
+        int64_t elapsed = rg_system_timer() - stats.markerTime;
+        stats.latency = elapsed + (int64_t)deviceSamples * 1000000 / sampleRate;
+        stats.markerPending = false;
+    }
+}
 
 static bool driver_init(int device, int _sampleRate)
 {
+    SDL_AudioSpec obtained;
     SDL_AudioSpec desired = {
-        .freq = sampleRate,
-        .format = AUDIO_S16,
+        .freq = _sampleRate,
+        .format = AUDIO_S16SYS,
         .channels = 2,
+        .samples = DEVICE_SAMPLES,
+        .callback = audio_callback,
     };
+    memset(&stats, 0, sizeof(stats));
+    stats.starved = true; // Silence until the first submit isn't an underrun
+    ring.head = ring.tail = 0;
     sampleRate = _sampleRate;
-    audioDevice = SDL_OpenAudioDevice(NULL, 0, &desired, NULL, 0);
-    return audioDevice != 0;
+    // We don't allow any changes, SDL will convert if the hardware can't do what we want
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
+    if (!audioDevice)
+        return false;
+    deviceSamples = obtained.samples;
+    SDL_PauseAudioDevice(audioDevice, 0);
+    return true;
 }
 
 static bool driver_deinit(void)
 {
     SDL_CloseAudioDevice(audioDevice);
+    audioDevice = 0;
     return true;
 }
 
 static bool driver_submit(const rg_audio_frame_t *frames, size_t count)
 {
-    SDL_QueueAudio(audioDevice, (void *)frames, count * 4);
-    SDL_PauseAudioDevice(audioDevice, 0);
-    // This is ugly, but we must emulate how it works on the ESP32, where the audio does the pacing!
-    static int64_t frame_start = 0;
-    int64_t frame_end = frame_start + (uint32_t)(count * (1000000.f / sampleRate)) - 500;
-    if (frame_end > rg_system_timer())
-        rg_usleep((frame_end - rg_system_timer()));
-    frame_start = rg_system_timer();
+    uint32_t head = ring.head;
+
+    while (count > 0)
+    {
+        // Stay about one device buffer ahead, like the DMA buffers do on the ESP32. The rest of the
+        // slack remains in rg_audio's queue, where the rate control and the counters can see it.
+        size_t queued = head - ring.tail;
+        if (queued > (size_t)deviceSamples)
+        {
+            SDL_Delay(1);
+            continue;
+        }
+        size_t chunk = RG_MIN(BUFFER_LENGTH - queued, count);
+        for (size_t i = 0; i < chunk; ++i)
+            ring.frames[(head + i) & (BUFFER_LENGTH - 1)] = frames[i];
+        head += chunk;
+        frames += chunk;
+        count -= chunk;
+        __sync_synchronize();
+        ring.head = head;
+    }
+
+    if (!stats.markerPending)
+    {
+        stats.markerPos = head;
+        stats.markerTime = rg_system_timer();
+        __sync_synchronize();
+        stats.markerPending = true;
+    }
+
     return true;
 }
 
 static bool driver_set_mute(bool mute)
 {
+    muted = mute;
     return true;
 }
 
-static bool driver_set_volume(int volume)
+static bool driver_get_counters(rg_audio_counters_t *counters)
 {
+    counters->underruns = stats.underruns;
+    counters->queuedSamples = ring.head - ring.tail;
+    counters->latency = stats.latency;
     return true;
 }
 
@@ -59,8 +160,9 @@ const rg_audio_driver_t rg_audio_driver_sdl2 = {
     .deinit = driver_deinit,
     .submit = driver_submit,
     .set_mute = driver_set_mute,
-    .set_volume = driver_set_volume,
+    .set_volume = NULL, // Done by rg_audio
     .set_sample_rate = NULL,
+    .get_counters = driver_get_counters,
     .get_error = driver_get_error,
 };
 
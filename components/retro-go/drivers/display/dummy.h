@@ -1,4 +1,5 @@
-static uint16_t lcd_buffer[LCD_BUFFER_LENGTH];
+static uint16_t lcd_buffers[2][LCD_BUFFER_LENGTH]; // Two blocks can be in flight with RG_SCREEN_PARALLEL_RENDER
+static int lcd_buffer_index;
 
 static void lcd_init(void)
 {
@@ -8,13 +9,17 @@ static void lcd_deinit(void)
 {
 }
 
+static void lcd_set_window(int left, int top, int width, int height)
+{
+}
+
 static void lcd_set_backlight(float percent)
 {
 }
 
 static inline uint16_t *lcd_get_buffer(size_t length)
 {
-    return lcd_buffer;
+    return lcd_buffers[lcd_buffer_index ^= 1];
 }
 
 static inline void lcd_send_buffer(uint16_t *buffer, size_t length)
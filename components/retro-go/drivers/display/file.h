@@ -0,0 +1,105 @@
+// Headless driver that records presented frames to RG_SCREEN_FILE_PATH instead of showing them.
+// RG_SCREEN_FILE_FORMAT: 0 = One hash per line (cheapest, for regression tests), 1 = Raw RGB565 LE, 2 = Y4M (444)
+// Only one in every RG_SCREEN_FILE_INTERVAL frames is written, but all of them are still rendered.
+
+static FILE *output;
+static uint16_t canvas[RG_SCREEN_HEIGHT * RG_SCREEN_WIDTH]; // Native RGB565
+static int win_left, win_top, win_width, win_height, cursor;
+static uint32_t frame_number;
+static uint16_t lcd_buffers[2][LCD_BUFFER_LENGTH]; // Two blocks can be in flight with RG_SCREEN_PARALLEL_RENDER
+static int lcd_buffer_index;
+
+static void lcd_init(void)
+{
+    output = fopen(RG_SCREEN_FILE_PATH, "wb");
+    if (!output)
+        RG_LOGE("Failed to open '%s', frames will be discarded.", RG_SCREEN_FILE_PATH);
+    else if (RG_SCREEN_FILE_FORMAT == 2)
+        fprintf(output, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", RG_SCREEN_WIDTH, RG_SCREEN_HEIGHT);
+    frame_number = 0;
+}
+
+static void lcd_deinit(void)
+{
+    if (output)
+        fclose(output);
+    output = NULL;
+}
+
+static void lcd_set_window(int left, int top, int width, int height)
+{
+    int right = left + width - 1;
+    int bottom = top + height - 1;
+    if (left < 0 || top < 0 || right >= RG_SCREEN_WIDTH || bottom >= RG_SCREEN_HEIGHT)
+        RG_LOGW("Bad lcd window (x0=%d, y0=%d, x1=%d, y1=%d)\n", left, top, right, bottom);
+    win_left = left;
+    win_top = top;
+    win_width = width;
+    win_height = height;
+    cursor = 0;
+}
+
+static void lcd_set_backlight(float percent)
+{
+}
+
+static inline uint16_t *lcd_get_buffer(size_t length)
+{
+    return lcd_buffers[lcd_buffer_index ^= 1];
+}
+
+static inline void lcd_send_buffer(uint16_t *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        int row = win_top + cursor / win_width;
+        int col = cursor % win_width;
+        int count = RG_MIN(win_width - col, (int)length);
+        int visible = RG_MIN(count, RG_SCREEN_WIDTH - (win_left + col));
+
+        if (row >= RG_SCREEN_HEIGHT)
+            break;
+
+        uint16_t *dst = canvas + row * RG_SCREEN_WIDTH + win_left + col;
+        for (int x = 0; x < visible; ++x)
+            dst[x] = (uint16_t)((buffer[x] << 8) | (buffer[x] >> 8));
+
+        buffer += count;
+        length -= count;
+        cursor += count;
+    }
+}
+
+static void write_y4m_frame(void)
+{
+    static uint8_t planes[3][RG_SCREEN_WIDTH * RG_SCREEN_HEIGHT];
+
+    for (size_t i = 0; i < RG_SCREEN_WIDTH * RG_SCREEN_HEIGHT; ++i)
+    {
+        // BT.601 limited range
+        int r = (canvas[i] >> 11) << 3, g = ((canvas[i] >> 5) & 0x3F) << 2, b = (canvas[i] & 0x1F) << 3;
+        planes[0][i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        planes[1][i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        planes[2][i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    fputs("FRAME\n", output);
+    fwrite(planes, sizeof(planes), 1, output);
+}
+
+static void lcd_sync(void)
+{
+    if (!output || (frame_number++ % RG_SCREEN_FILE_INTERVAL) != 0)
+        return;
+
+    if (RG_SCREEN_FILE_FORMAT == 0)
+        fprintf(output, "%u %08X\n", (unsigned)frame_number - 1, (unsigned)rg_hash((const char *)canvas, sizeof(canvas)));
+    else if (RG_SCREEN_FILE_FORMAT == 1)
+        fwrite(canvas, sizeof(canvas), 1, output);
+    else if (RG_SCREEN_FILE_FORMAT == 2)
+        write_y4m_frame();
+}
+
+const rg_display_driver_t rg_display_driver_file = {
+    .name = "file",
+};
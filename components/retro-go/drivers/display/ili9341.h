@@ -9,14 +9,19 @@ static QueueHandle_t spi_transactions;
 static QueueHandle_t spi_buffers;
 
 #define SPI_TRANSACTION_COUNT (10)
-#define SPI_BUFFER_COUNT      (5)
+#define SPI_BUFFER_COUNT      (5) // RG_SCREEN_PARALLEL_RENDER holds two while the others are in the DMA queue
 #define SPI_BUFFER_LENGTH     (LCD_BUFFER_LENGTH * 2)
 
 static inline uint16_t *spi_take_buffer(void)
 {
     uint16_t *buffer;
+    // Only trace the waits, the buffers are usually available
+    if (xQueueReceive(spi_buffers, &buffer, 0) == pdTRUE)
+        return buffer;
+    rg_system_trace(RG_TRACE_DMA_WAIT, true);
     if (xQueueReceive(spi_buffers, &buffer, pdMS_TO_TICKS(2500)) != pdTRUE)
         RG_PANIC("display");
+    rg_system_trace(RG_TRACE_DMA_WAIT, false);
     return buffer;
 }
 
@@ -1,19 +1,34 @@
 #include <SDL2/SDL.h>
 
 static SDL_Window *window;
-static SDL_Surface *surface, *canvas;
+static SDL_Renderer *renderer;
+static SDL_Texture *texture;
+static SDL_mutex *lcd_lock;
+static uint16_t canvas[RG_SCREEN_HEIGHT * RG_SCREEN_WIDTH]; // Native RGB565, what the texture expects
 static int win_left, win_top, win_width, win_height, cursor;
-static uint16_t lcd_buffer[LCD_BUFFER_LENGTH];
+static int dirty_top, dirty_bottom;
+static uint16_t lcd_buffers[2][LCD_BUFFER_LENGTH]; // Two blocks can be in flight with RG_SCREEN_PARALLEL_RENDER
+static int lcd_buffer_index;
 
 static void lcd_init(void)
 {
     window = SDL_CreateWindow("Retro-Go", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, RG_SCREEN_WIDTH, RG_SCREEN_HEIGHT, 0);
-    surface = SDL_GetWindowSurface(window);
-    canvas = SDL_CreateRGBSurfaceWithFormat(0, RG_SCREEN_WIDTH, RG_SCREEN_HEIGHT, 16, SDL_PIXELFORMAT_RGB565);
+    renderer = SDL_CreateRenderer(window, -1, RG_SCREEN_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0);
+    if (!renderer)
+        RG_PANIC("SDL_CreateRenderer failed!");
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING, RG_SCREEN_WIDTH, RG_SCREEN_HEIGHT);
+    lcd_lock = SDL_CreateMutex();
+    dirty_top = 0;
+    dirty_bottom = RG_SCREEN_HEIGHT;
 }
 
 static void lcd_deinit(void)
 {
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_DestroyMutex(lcd_lock);
+    texture = NULL, renderer = NULL, window = NULL, lcd_lock = NULL;
 }
 
 static void lcd_set_window(int left, int top, int width, int height)
@@ -35,30 +50,48 @@ static void lcd_set_backlight(float percent)
 
 static inline uint16_t *lcd_get_buffer(size_t length)
 {
-    return lcd_buffer;
+    return lcd_buffers[lcd_buffer_index ^= 1];
 }
 
 static inline void lcd_send_buffer(uint16_t *buffer, size_t length)
 {
-    int bpp = canvas->format->BytesPerPixel;
-    int pitch = canvas->pitch;
-    void *pixels = canvas->pixels;
-    for (size_t i = 0; i < length; ++i) {
-        int real_top = win_top + (cursor / win_width);
-        int real_left = win_left + (cursor % win_width);
-        if (real_top >= RG_SCREEN_HEIGHT || real_left >= RG_SCREEN_WIDTH)
-            return;
-        uint16_t *dst = (void*)pixels + (real_top * pitch) + (real_left * bpp);
-        uint16_t pixel = buffer[i];
-        *dst = ((pixel & 0xFF) << 8) | ((pixel & 0xFF00) >> 8);;
-        cursor++;
+    // Copy a window row at a time, the swap loop is simple enough to be vectorized
+    while (length > 0)
+    {
+        int row = win_top + cursor / win_width;
+        int col = cursor % win_width;
+        int count = RG_MIN(win_width - col, (int)length);
+        int visible = RG_MIN(count, RG_SCREEN_WIDTH - (win_left + col));
+
+        if (row >= RG_SCREEN_HEIGHT)
+            break;
+
+        uint16_t *dst = canvas + row * RG_SCREEN_WIDTH + win_left + col;
+        for (int x = 0; x < visible; ++x)
+            dst[x] = (uint16_t)((buffer[x] << 8) | (buffer[x] >> 8));
+
+        dirty_top = RG_MIN(dirty_top, row);
+        dirty_bottom = RG_MAX(dirty_bottom, row + 1);
+        buffer += count;
+        length -= count;
+        cursor += count;
     }
 }
 
 static void lcd_sync(void)
 {
-    SDL_BlitSurface(canvas, NULL, surface, NULL);
-    SDL_UpdateWindowSurface(window);
+    // Called from both the display task and rg_display_write_rect's caller
+    SDL_LockMutex(lcd_lock);
+    if (dirty_top < dirty_bottom)
+    {
+        SDL_Rect rect = {0, dirty_top, RG_SCREEN_WIDTH, dirty_bottom - dirty_top};
+        SDL_UpdateTexture(texture, &rect, canvas + dirty_top * RG_SCREEN_WIDTH, RG_SCREEN_WIDTH * 2);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        dirty_top = RG_SCREEN_HEIGHT;
+        dirty_bottom = 0;
+    }
+    SDL_UnlockMutex(lcd_lock);
 }
 
 const rg_display_driver_t rg_display_driver_sdl2 = {
@@ -3,11 +3,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 extern const rg_audio_driver_t rg_audio_driver_dummy;
 extern const rg_audio_driver_t rg_audio_driver_buzzer;
 extern const rg_audio_driver_t rg_audio_driver_i2s;
 extern const rg_audio_driver_t rg_audio_driver_sdl2;
+extern const rg_audio_driver_t rg_audio_driver_file;
 
 // static const rg_audio_driver_t *drivers[] = {
 //     NULL,
@@ -26,6 +28,9 @@ static const rg_audio_sink_t sinks[] = {
 #endif
 #if RG_AUDIO_USE_BUZZER_PIN
     {&rg_audio_driver_buzzer, 0, "Buzzer" },
+#endif
+#if RG_AUDIO_USE_FILE
+    {&rg_audio_driver_file,   0, "File"   },
 #endif
     // {rg_audio_driver_bt_a2dp, 0, "Bluetooth"},
 };
@@ -39,17 +44,64 @@ static const rg_audio_sink_t sinks[] = {
     })
 #define RELEASE_DEVICE() rg_mutex_give(audio.lock)
 
+#define RING_MASK (RG_AUDIO_BUFFER_LENGTH - 1)
+#define TASK_CHUNK_LENGTH 128
+#define SINC_TAPS 8
+#define SINC_PHASES 64
+
 static struct
 {
     const rg_audio_sink_t *sink;
     const rg_audio_driver_t *driver;
     rg_mutex_t *lock;
-    int sampleRate;
+    rg_task_t *task;
+    rg_semaphore_t *ready; // Given by rg_audio_submit when it publishes frames and the task is waiting
+    volatile bool waiting;
+    int sampleRate; // Rate of the submitted samples
+    int deviceRate; // Rate the sink was opened at, it never changes after that
+    float rateControl;
     int filter;
     int volume;
     bool muted;
 } audio;
 static rg_audio_counters_t counters;
+static struct
+{
+    int64_t start;
+    int32_t minQueued;
+    int32_t maxQueued;
+} window;
+
+// Single producer (rg_audio_submit) single consumer (audio_task) ring. Only the producer writes head
+// and only the consumer writes tail, the indexes wrap naturally and are masked on access.
+static struct
+{
+    rg_audio_frame_t *frames;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} ring;
+
+// Converts sampleRate to deviceRate, either with linear interpolation or a windowed sinc polyphase filter.
+// history is doubled so that the last SINC_TAPS frames are always contiguous at history[index + 1].
+// pos is the 16.16 position of the next output frame between the two middle frames of that window.
+static struct
+{
+    rg_audio_frame_t history[SINC_TAPS * 2];
+    size_t index;
+    uint32_t pos;
+    uint32_t step;
+    float fill;
+    int16_t coefs[SINC_PHASES][SINC_TAPS]; // Q14
+    // rg_audio_set_sample_rate can be called while another task submits, it prepares the new ratio here
+    // and rg_audio_submit swaps it in between two blocks
+    struct
+    {
+        int16_t coefs[SINC_PHASES][SINC_TAPS];
+        uint32_t step;
+    } next;
+    volatile bool swap;
+    rg_mutex_t *lock;
+} resampler;
 
 static const char *SETTING_DRIVER = "AudioDriver";
 static const char *SETTING_DEVICE = "AudioDevice";
@@ -63,6 +115,160 @@ static const char *get_last_driver_error(void)
     return "Unspecified Error";
 }
 
+static void update_resampler(void)
+{
+    // The cutoff is lowered when downsampling to avoid aliasing, and kept a bit below nyquist regardless
+    float cutoff = RG_MIN(1.f, (float)audio.deviceRate / audio.sampleRate) * 0.9f;
+
+    for (int phase = 0; phase < SINC_PHASES; ++phase)
+    {
+        float taps[SINC_TAPS], sum = 0.f;
+        for (int k = 0; k < SINC_TAPS; ++k)
+        {
+            float x = k - (SINC_TAPS / 2 - 1) - (float)phase / SINC_PHASES;
+            float sinc = x == 0.f ? 1.f : sinf(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            float window = 0.42f + 0.5f * cosf(M_PI * x / (SINC_TAPS / 2)) + 0.08f * cosf(2 * M_PI * x / (SINC_TAPS / 2));
+            taps[k] = sinc * window;
+            sum += taps[k];
+        }
+        // Normalize each phase for unity gain, otherwise DC would ripple with the phase
+        for (int k = 0; k < SINC_TAPS; ++k)
+            resampler.next.coefs[phase][k] = (int16_t)lroundf(taps[k] / sum * (1 << 14));
+    }
+
+    resampler.next.step = (uint32_t)(0x10000 * (double)audio.sampleRate / audio.deviceRate);
+}
+
+static void swap_resampler(void)
+{
+    memcpy(resampler.coefs, resampler.next.coefs, sizeof(resampler.coefs));
+    resampler.step = resampler.next.step;
+    resampler.swap = false;
+}
+
+// A frame is handled as one 32bit word holding both channels, so the mixing does two samples per add.
+// The lanes are symmetrical so the byte order doesn't matter.
+static inline uint32_t load_2x16(const void *src)
+{
+    uint32_t word;
+    memcpy(&word, src, 4);
+    return word;
+}
+
+static inline int16_t clamp_16(int value)
+{
+    return value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+}
+
+static inline uint32_t scale_2x16(uint32_t word, int gain)
+{
+    uint32_t lo = (uint16_t)clamp_16(((int16_t)word * gain) >> 8);
+    uint32_t hi = (uint16_t)clamp_16(((int16_t)(word >> 16) * gain) >> 8);
+    return lo | (hi << 16);
+}
+
+// The low 15 bits of each lane are added without carrying into the next lane, then the sign bits are
+// xored back in. A lane overflowed if both inputs share a sign that the sum doesn't, it is then
+// clamped to 0x7FFF or 0x8000 according to that sign.
+static inline uint32_t add_sat_2x16(uint32_t a, uint32_t b)
+{
+    uint32_t sum = ((a & 0x7FFF7FFF) + (b & 0x7FFF7FFF)) ^ ((a ^ b) & 0x80008000);
+    uint32_t overflow = ~(a ^ b) & (a ^ sum) & 0x80008000;
+    uint32_t mask = (overflow >> 15) * 0xFFFF;
+    uint32_t clamp = 0x7FFF7FFF + ((a >> 15) & 0x00010001);
+    return (sum & ~mask) | (clamp & mask);
+}
+
+IRAM_ATTR void rg_audio_mix(rg_audio_frame_t *out, const rg_audio_stream_t *streams, size_t streams_count, size_t count)
+{
+    if (!streams_count)
+        memset(out, 0, count * sizeof(rg_audio_frame_t));
+
+    for (size_t s = 0; s < streams_count; ++s)
+    {
+        const int16_t *src = streams[s].samples;
+        int gain = src ? RG_MAX(streams[s].gain, 0) : 0;
+        bool stereo = streams[s].channels == 2;
+        bool first = s == 0; // The first stream overwrites out, so out can also be its source
+
+        if (gain == 0)
+        {
+            if (first)
+                memset(out, 0, count * sizeof(rg_audio_frame_t));
+            continue;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t word;
+            if (stereo)
+                word = load_2x16(&src[i * 2]);
+            else
+                word = (uint16_t)src[i] * 0x10001u;
+            if (gain != RG_AUDIO_GAIN_UNITY)
+                word = scale_2x16(word, gain);
+            if (!first)
+                word = add_sat_2x16(load_2x16(&out[i]), word);
+            memcpy(&out[i], &word, 4);
+        }
+    }
+}
+
+static void audio_task(void *arg)
+{
+    rg_audio_frame_t buffer[TASK_CHUNK_LENGTH];
+    bool flowing = false;
+
+    while (true)
+    {
+        size_t count = 0;
+
+        // The lock ensures that the driver isn't swapped under us, the ring itself doesn't need it
+        if (ACQUIRE_DEVICE(1000))
+        {
+            uint32_t tail = ring.tail;
+            if (audio.driver)
+                count = RG_MIN(ring.head - tail, TASK_CHUNK_LENGTH);
+            __sync_synchronize();
+            for (size_t i = 0; i < count; ++i)
+                buffer[i] = ring.frames[(tail + i) & RING_MASK];
+            __sync_synchronize();
+            ring.tail = tail + count;
+            // Sinks without their own volume control get it done here
+            if (count && !audio.driver->set_volume)
+            {
+                int gain = audio.muted ? 0 : audio.volume * RG_AUDIO_GAIN_UNITY / 100;
+                if (gain != RG_AUDIO_GAIN_UNITY)
+                    rg_audio_mix(buffer, &(rg_audio_stream_t){(int16_t *)buffer, 2, gain}, 1, count);
+            }
+            // The producer can refill the ring while the driver blocks
+            if (count)
+            {
+                rg_system_trace(RG_TRACE_AUDIO_SUBMIT, true);
+                audio.driver->submit(buffer, count);
+                rg_system_trace(RG_TRACE_AUDIO_SUBMIT, false);
+            }
+            RELEASE_DEVICE();
+        }
+
+        // Only count the transitions, a paused emulator isn't a stream of underruns. Drivers that
+        // know better (because they see the actual device) will override this in get_counters.
+        if (!count && flowing)
+            counters.underruns++;
+        flowing = count > 0;
+
+        // Sleep until the producer publishes more frames, the timeout only covers a sink swap or deinit
+        if (!count)
+        {
+            audio.waiting = true;
+            __sync_synchronize();
+            if (ring.head == ring.tail)
+                rg_semaphore_take(audio.ready, 100);
+            audio.waiting = false;
+        }
+    }
+}
+
 void rg_audio_init(int sampleRate)
 {
     RG_ASSERT(audio.sink == NULL, "Audio sink already initialized!");
@@ -72,8 +278,29 @@ void rg_audio_init(int sampleRate)
         audio.lock = rg_mutex_create();
         RELEASE_DEVICE();
     }
+    if (!resampler.lock)
+        resampler.lock = rg_mutex_create();
+    if (!ring.frames)
+    {
+        ring.frames = rg_alloc(RG_AUDIO_BUFFER_LENGTH * sizeof(rg_audio_frame_t), MEM_ANY);
+        ring.head = ring.tail = 0;
+    }
+    if (!audio.task)
+    {
+        audio.ready = rg_semaphore_create();
+        // Next to rg_display, away from the emulator that fills the ring
+        audio.task = rg_task_create("rg_audio", &audio_task, NULL, 3 * 1024, RG_TASK_PRIORITY_7, 1);
+    }
     ACQUIRE_DEVICE(1000);
 
+    // Drop whatever was left from the previous sink, the task won't touch the ring while we hold the lock
+    ring.tail = ring.head;
+    memset(resampler.history, 0, sizeof(resampler.history));
+    resampler.pos = 0;
+    window.start = counters.totalSamples;
+    window.minQueued = INT32_MAX;
+    window.maxQueued = 0;
+
     char *driver_name = rg_settings_get_string(NS_GLOBAL, SETTING_DRIVER, "DEFAULT");
     int device = rg_settings_get_number(NS_GLOBAL, SETTING_DEVICE, 0);
     for (size_t i = 0; i < RG_COUNT(sinks); ++i)
@@ -86,10 +313,21 @@ void rg_audio_init(int sampleRate)
     if (!audio.sink) // Default to first non-dummy if no match found
         audio.sink = &sinks[1 % RG_COUNT(sinks)];
 
-    audio.filter = (int)rg_settings_get_number(NS_GLOBAL, SETTING_FILTER, 0);
+    audio.filter = (int)rg_settings_get_number(NS_GLOBAL, SETTING_FILTER, RG_AUDIO_FILTER_SINC);
     audio.volume = (int)rg_settings_get_number(NS_GLOBAL, SETTING_VOLUME, 50);
     audio.sampleRate = sampleRate;
+    audio.deviceRate = sampleRate;
     audio.driver = audio.sink->driver;
+    audio.rateControl = RG_AUDIO_RATE_CONTROL;
+#if RG_AUDIO_USE_FILE
+    // The recording sink has no clock to follow and we want the samples exactly as submitted
+    if (audio.driver == &rg_audio_driver_file)
+        audio.rateControl = 0.f;
+#endif
+    rg_mutex_take(resampler.lock, -1);
+    update_resampler();
+    swap_resampler();
+    rg_mutex_give(resampler.lock);
 
     if (audio.driver->init(audio.sink->device, sampleRate))
     {
@@ -131,6 +369,25 @@ void rg_audio_deinit(void)
     RELEASE_DEVICE();
 }
 
+static size_t wait_for_space(uint32_t head)
+{
+    const int64_t time_start = rg_system_timer();
+    size_t space;
+
+    __sync_synchronize();
+    ring.head = head;
+    if (audio.waiting)
+        rg_semaphore_give(audio.ready);
+
+    // Blocking here is what paces emulation when nothing else does, like the driver used to
+    while ((space = RG_AUDIO_BUFFER_LENGTH - (head - ring.tail)) == 0 && audio.driver)
+        rg_usleep(1000);
+
+    counters.overruns++;
+    counters.blockedTime += rg_system_timer() - time_start;
+    return space;
+}
+
 void rg_audio_submit(const rg_audio_frame_t *frames, size_t count)
 {
     const int64_t time_start = rg_system_timer();
@@ -141,10 +398,100 @@ void rg_audio_submit(const rg_audio_frame_t *frames, size_t count)
     if (!frames || !count)
         return;
 
-    if (ACQUIRE_DEVICE(0))
+    // Never wait for the lock, the new ratio can as well be picked up on the next call
+    if (resampler.swap && rg_mutex_take(resampler.lock, 0))
     {
-        audio.driver->submit(frames, count);
-        RELEASE_DEVICE();
+        swap_resampler();
+        rg_mutex_give(resampler.lock);
+    }
+
+    uint32_t head = ring.head;
+    size_t space = RG_AUDIO_BUFFER_LENGTH - (head - ring.tail);
+    size_t space_before = space;
+
+    // Nudge the ratio to keep the ring half full, so that small drifts between the emulation and the DAC
+    // clocks don't end in underruns (crackles) or stalls. We submit in bursts so we track the middle
+    // of the burst, smoothed over a few calls.
+    resampler.fill += ((RG_AUDIO_BUFFER_LENGTH - space + count / 2) - resampler.fill) * 0.1f;
+    float error = (resampler.fill - RG_AUDIO_BUFFER_LENGTH / 2) / (RG_AUDIO_BUFFER_LENGTH / 2);
+    uint32_t step = resampler.step * (1.f + audio.rateControl * RG_MIN(RG_MAX(error, -1.f), 1.f));
+
+    if (step == 0x10000 && audio.rateControl == 0.f)
+    {
+        // Nothing to resample, pass the frames through untouched
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (space == 0 && (space = wait_for_space(head)) == 0)
+                return;
+            ring.frames[head++ & RING_MASK] = frames[i];
+            space--;
+        }
+    }
+    else
+    {
+        rg_audio_frame_t *history = resampler.history;
+        size_t index = resampler.index;
+        uint32_t pos = resampler.pos;
+        bool linear = audio.filter == RG_AUDIO_FILTER_LINEAR;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            index = (index + 1) % SINC_TAPS;
+            history[index] = history[index + SINC_TAPS] = frames[i];
+
+            const rg_audio_frame_t *window = &history[index + 1];
+
+            for (; pos < 0x10000; pos += step)
+            {
+                if (space == 0 && (space = wait_for_space(head)) == 0)
+                    return;
+
+                int left, right;
+                if (linear)
+                {
+                    const rg_audio_frame_t *a = &window[SINC_TAPS / 2 - 1], *b = &window[SINC_TAPS / 2];
+                    int weight = pos >> 1; // 15 bits so that the product fits in an int
+                    left = a->left + (((b->left - a->left) * weight) >> 15);
+                    right = a->right + (((b->right - a->right) * weight) >> 15);
+                }
+                else
+                {
+                    const int16_t *coefs = resampler.coefs[pos / (0x10000 / SINC_PHASES)];
+                    left = right = 0;
+                    for (int k = 0; k < SINC_TAPS; ++k)
+                    {
+                        left += window[k].left * coefs[k];
+                        right += window[k].right * coefs[k];
+                    }
+                    left = RG_MIN(RG_MAX(left >> 14, -32768), 32767);
+                    right = RG_MIN(RG_MAX(right >> 14, -32768), 32767);
+                }
+
+                ring.frames[head++ & RING_MASK] = (rg_audio_frame_t){left, right};
+                space--;
+            }
+            pos -= 0x10000;
+        }
+
+        resampler.index = index;
+        resampler.pos = pos;
+    }
+
+    __sync_synchronize();
+    ring.head = head;
+    if (audio.waiting)
+        rg_semaphore_give(audio.ready);
+
+    // The lowest point is right before we write and the highest right after, publish once per second of audio
+    window.minQueued = RG_MIN(window.minQueued, RG_AUDIO_BUFFER_LENGTH - (int32_t)space_before);
+    window.maxQueued = RG_MAX(window.maxQueued, (int32_t)(head - ring.tail));
+    if (counters.totalSamples - window.start >= audio.sampleRate)
+    {
+        counters.minQueued = window.minQueued;
+        counters.maxQueued = window.maxQueued;
+        window.start = counters.totalSamples;
+        window.minQueued = INT32_MAX;
+        window.maxQueued = 0;
     }
 
     counters.totalSamples += count;
@@ -153,7 +500,16 @@ void rg_audio_submit(const rg_audio_frame_t *frames, size_t count)
 
 rg_audio_counters_t rg_audio_get_counters(void)
 {
-    return counters;
+    rg_audio_counters_t out = counters;
+    const rg_audio_driver_t *driver = audio.driver;
+    if (driver && driver->get_counters)
+        driver->get_counters(&out);
+    // The sink only knows about its own queue, add ours
+    int pending = ring.head - ring.tail;
+    out.queuedSamples += pending;
+    if (audio.deviceRate > 0)
+        out.latency += (int64_t)pending * 1000000 / audio.deviceRate;
+    return out;
 }
 
 const char *rg_audio_get_driver(void)
@@ -180,8 +536,10 @@ void rg_audio_set_sink(const char *driver_name, int device)
     RG_LOGI("%s %d", driver_name, device);
     rg_settings_set_string(NS_GLOBAL, SETTING_DRIVER, driver_name);
     rg_settings_set_number(NS_GLOBAL, SETTING_DEVICE, device);
+    int sampleRate = audio.sampleRate;
     rg_audio_deinit();
-    rg_audio_init(audio.sampleRate);
+    rg_audio_init(audio.deviceRate);
+    rg_audio_set_sample_rate(sampleRate);
 }
 
 int rg_audio_get_volume(void)
@@ -230,18 +588,12 @@ void rg_audio_set_sample_rate(int sampleRate)
     if (audio.sampleRate == sampleRate)
         return;
 
-    if (audio.driver->set_sample_rate)
-    {
-        if (ACQUIRE_DEVICE(1000))
-        {
-            audio.driver->set_sample_rate(sampleRate);
-            audio.sampleRate = sampleRate;
-            RELEASE_DEVICE();
-        }
-    }
-    else
-    {
-        rg_audio_deinit();
-        rg_audio_init(sampleRate);
-    }
+    // The device keeps running at its own rate, only the resampling ratio changes. Some cores submit from
+    // their own task, so the new coefficients are staged and rg_audio_submit swaps them in between two blocks.
+    rg_mutex_take(resampler.lock, -1);
+    audio.sampleRate = sampleRate;
+    update_resampler();
+    resampler.swap = true;
+    rg_mutex_give(resampler.lock);
+    RG_LOGI("Sample rate set to %d (device: %d)\n", audio.sampleRate, audio.deviceRate);
 }
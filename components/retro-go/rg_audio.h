@@ -11,6 +11,19 @@ typedef struct // __attribute__((packed))
 
 typedef rg_audio_frame_t rg_audio_sample_t;
 
+typedef struct
+{
+    int64_t totalSamples;
+    int64_t busyTime;
+    int64_t blockedTime;   // Part of busyTime spent waiting for room, the rest is resampling and copying
+    int64_t underruns;     // Number of times the sink ran out of samples
+    int64_t overruns;      // Number of times rg_audio_submit found the queue full
+    int32_t queuedSamples; // Frames waiting to be played, in rg_audio and in the sink
+    int32_t minQueued;     // Lowest and highest fill of our queue during the last second of audio
+    int32_t maxQueued;
+    int32_t latency;       // Time for a submitted frame to be heard, in microseconds
+} rg_audio_counters_t;
+
 typedef struct
 {
     const char *name;                                             // Required
@@ -20,6 +33,7 @@ typedef struct
     bool (*set_mute)(bool mute);                                  // Optional
     bool (*set_volume)(int percent);                              // Optional
     bool (*set_sample_rate)(int sample_rate);                     // Optional
+    bool (*get_counters)(rg_audio_counters_t *counters);          // Optional
     const char *(*get_error)(void);                               // Optional
 } rg_audio_driver_t;
 
@@ -30,11 +44,20 @@ typedef struct
     const char *name;
 } rg_audio_sink_t;
 
+typedef enum
+{
+    RG_AUDIO_FILTER_LINEAR = 0, // Fast linear interpolation
+    RG_AUDIO_FILTER_SINC,       // Band-limited polyphase filter
+} rg_audio_filter_t;
+
+#define RG_AUDIO_GAIN_UNITY 256 // Gains are 8.8 fixed point
+
 typedef struct
 {
-    int64_t totalSamples;
-    int64_t busyTime;
-} rg_audio_counters_t;
+    const int16_t *samples; // Interleaved if stereo, mono samples go to both channels
+    int channels;           // 1 or 2
+    int gain;               // RG_AUDIO_GAIN_UNITY = unchanged, can go above to amplify
+} rg_audio_stream_t;
 
 void rg_audio_init(int sample_rate);
 void rg_audio_deinit(void);
@@ -52,5 +75,9 @@ int rg_audio_get_volume(void);
 void rg_audio_set_volume(int percent);
 bool rg_audio_get_mute(void);
 void rg_audio_set_mute(bool mute);
+// The sample rate is that of the submitted samples, they are resampled to the rate the sink was opened at
 int rg_audio_get_sample_rate(void);
 void rg_audio_set_sample_rate(int sample_rate);
+
+// Sums count frames of each stream into out, saturating instead of wrapping. out may be the first stream.
+void rg_audio_mix(rg_audio_frame_t *out, const rg_audio_stream_t *streams, size_t streams_count, size_t count);
@@ -5,19 +5,76 @@
 #include <string.h>
 
 #define LCD_BUFFER_LENGTH (RG_SCREEN_WIDTH * 4) // In pixels
+#define DIRTY_LINES_MAX   (512) // Tallest source supported by rg_display_submit_dirty
+
+// Horizontally filtered rows for the area filter, one cache per renderer
+typedef struct
+{
+    uint32_t rows[2][RG_SCREEN_WIDTH];
+    int line[2];
+    int next;
+} area_cache_t;
+
+// Everything needed to render any block of the current update, shared with the render worker
+typedef struct
+{
+    const rg_surface_t *update;
+    const void *data; // Cropped
+    const uint32_t *dirty_lines;
+    int crop_left, crop_top;
+    int draw_left, draw_top, draw_width, draw_height;
+    bool partial_update, rotated;
+    bool filter_x, filter_y, filter_area;
+} render_state_t;
+
+typedef struct
+{
+    const render_state_t *state;
+    uint16_t *buffer;
+    int y, lines;
+    bool need_update;
+    int32_t stage_time[RG_DISPLAY_STAGE_COUNT];
+} render_job_t;
+
+// Renders `width` pixels from a source line to the LCD's big endian format. `width` is always even.
+// The output is written two pixels at a time, the first pixel in the low half (both targets are LE).
+typedef void (*line_renderer_t)(uint32_t *dst, const void *src, const uint16_t *palette, int width);
 
 // static rg_display_driver_t driver;
 static rg_task_t *display_task_queue;
 static rg_display_counters_t counters;
 static rg_display_config_t config;
-static rg_surface_t *osd;
+static const rg_surface_t *osd;
+static int osd_left, osd_top;
+static uint32_t osd_damage; // Screen lines (top << 16 | bottom), written by any task and taken by the display task
 static rg_surface_t *border;
 static rg_display_t display;
 static int16_t map_viewport_to_source_x[RG_SCREEN_WIDTH + 1];
 static int16_t map_viewport_to_source_y[RG_SCREEN_HEIGHT + 1];
+static uint8_t area_weight_x[RG_SCREEN_WIDTH + 1];
+static uint8_t area_weight_y[RG_SCREEN_HEIGHT + 1];
 static uint32_t screen_line_checksum[RG_SCREEN_HEIGHT + 1];
+static line_renderer_t line_renderer;
+static uint32_t submit_dirty_lines[2][DIRTY_LINES_MAX / 32];
+static uint32_t source_line_checksum[DIRTY_LINES_MAX];
+static uint32_t source_palette_checksum;
+static int submit_dirty_slot;
+static area_cache_t area_caches[2];
+static render_state_t render_state;
+static int16_t render_blocks[RG_SCREEN_HEIGHT][2]; // y, lines
+#if RG_SCREEN_PARALLEL_RENDER
+static rg_task_t *render_worker_queue;
+static rg_semaphore_t *render_worker_done;
+static render_job_t render_worker_job;
+#endif
 
 #define LINE_IS_REPEATED(Y) (map_viewport_to_source_y[(Y)] == map_viewport_to_source_y[(Y) - 1])
+#define SWAP_565_X2(v) ((((v) & 0x00FF00FFu) << 8) | (((v) >> 8) & 0x00FF00FFu))
+#define SWAP_565(v) ((uint16_t)(((v) << 8) | ((v) >> 8)))
+// Spreads a native RGB565 value to 0b00000GGGGGG00000RRRRR000000BBBBB so that all channels can be
+// multiplied by a 5bit weight at once without overflowing into each other
+#define AREA_SPREAD(c) (((c) | ((uint32_t)(c) << 16)) & 0x07E0F81Fu)
+#define AREA_BLEND(a, b, w) ((((a) * (w) + (b) * (32 - (w))) >> 5) & 0x07E0F81Fu)
 // This is to avoid flooring a number that is approximated to .9999999 and be explicit about it
 #define FLOAT_TO_INT(x) ((int)((x) + 0.1f))
 
@@ -30,6 +87,8 @@ static const char *SETTING_CUSTOM_ZOOM = "DispCustomZoom";
 
 #if RG_SCREEN_DRIVER == 0 /* ILI9341 */
 #include "drivers/display/ili9341.h"
+#elif RG_SCREEN_DRIVER == 98 /* Headless recording */
+#include "drivers/display/file.h"
 #elif RG_SCREEN_DRIVER == 99
 #include "drivers/display/sdl2.h"
 #else
@@ -54,12 +113,385 @@ static inline unsigned blend_pixels(unsigned a, unsigned b)
     // return (((a ^ b) & 0b1101111011110110U) >> 1) + (a & b);
 }
 
-static inline void write_update(const rg_surface_t *update)
+// 1:1 kernels
+IRAM_ATTR static void render_line_1x_pal(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint8_t *in = src;
+    for (int x = 0; x < width; x += 2)
+        *dst++ = palette[in[x]] | ((uint32_t)palette[in[x + 1]] << 16);
+}
+
+IRAM_ATTR static void render_line_1x_565_be(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    memcpy(dst, src, width * 2);
+}
+
+IRAM_ATTR static void render_line_1x_565_le(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint16_t *in = src;
+    for (int x = 0; x < width; x += 2)
+    {
+        uint32_t pair = in[x] | ((uint32_t)in[x + 1] << 16);
+        *dst++ = SWAP_565_X2(pair);
+    }
+}
+
+// Exact 2x kernels, each source pixel becomes a pair
+IRAM_ATTR static void render_line_2x_pal(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint8_t *in = src;
+    for (int x = 0; x < width / 2; ++x)
+    {
+        uint32_t pixel = palette[in[x]];
+        *dst++ = pixel | (pixel << 16);
+    }
+}
+
+IRAM_ATTR static void render_line_2x_565_be(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint16_t *in = src;
+    for (int x = 0; x < width / 2; ++x)
+    {
+        uint32_t pixel = in[x];
+        *dst++ = pixel | (pixel << 16);
+    }
+}
+
+IRAM_ATTR static void render_line_2x_565_le(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint16_t *in = src;
+    for (int x = 0; x < width / 2; ++x)
+    {
+        uint32_t pixel = ((in[x] << 8) | (in[x] >> 8)) & 0xFFFF;
+        *dst++ = pixel | (pixel << 16);
+    }
+}
+
+// Arbitrary scale kernels, they go through map_viewport_to_source_x
+IRAM_ATTR static void render_line_scaled_pal(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint8_t *in = src;
+    const int16_t *map = map_viewport_to_source_x;
+    for (int x = 0; x < width; x += 2)
+        *dst++ = palette[in[map[x]]] | ((uint32_t)palette[in[map[x + 1]]] << 16);
+}
+
+IRAM_ATTR static void render_line_scaled_565_be(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint16_t *in = src;
+    const int16_t *map = map_viewport_to_source_x;
+    for (int x = 0; x < width; x += 2)
+        *dst++ = in[map[x]] | ((uint32_t)in[map[x + 1]] << 16);
+}
+
+IRAM_ATTR static void render_line_scaled_565_le(uint32_t *dst, const void *src, const uint16_t *palette, int width)
+{
+    const uint16_t *in = src;
+    const int16_t *map = map_viewport_to_source_x;
+    for (int x = 0; x < width; x += 2)
+    {
+        uint32_t pair = in[map[x]] | ((uint32_t)in[map[x + 1]] << 16);
+        *dst++ = SWAP_565_X2(pair);
+    }
+}
+
+// Rotated scan-out: a block of output lines is a block of adjacent source columns. Instead of walking down
+// each column separately, we walk the source rows once per block and scatter each row across all the lines,
+// so that reads remain sequential and the source stays in cache.
+IRAM_ATTR static void render_block_rotated(uint16_t *dst, const rg_surface_t *update, int crop_left, int crop_top,
+                                           int y, int lines, int width)
+{
+    const bool rotate_left = display.viewport.rotation == RG_DISPLAY_ROTATION_LEFT;
+    const uint16_t *palette = update->palette;
+    const void *data = update->data + update->offset;
+    const int format = update->format;
+    const int stride = update->stride;
+    int columns[lines];
+
+    for (int i = 0; i < lines; ++i)
+    {
+        int column = crop_top + map_viewport_to_source_y[y + i];
+        columns[i] = rotate_left ? update->width - 1 - column : column;
+    }
+
+    #define RENDER_TILE(PTR_TYPE, PIXEL) \
+        for (int x = 0; x < width; ++x) { \
+            int row = crop_left + map_viewport_to_source_x[x]; \
+            const PTR_TYPE *buffer = data + (rotate_left ? row : update->height - 1 - row) * stride; \
+            for (int i = 0; i < lines; ++i) { \
+                PTR_TYPE pixel = buffer[columns[i]]; \
+                dst[i * width + x] = (PIXEL); \
+            } \
+        }
+    if (format & RG_PIXEL_PALETTE)
+        RENDER_TILE(uint8_t, palette[pixel])
+    else if (format == RG_PIXEL_565_LE)
+        RENDER_TILE(uint16_t, (pixel << 8) | (pixel >> 8))
+    else
+        RENDER_TILE(uint16_t, pixel)
+    #undef RENDER_TILE
+}
+
+// Area filter: each output pixel is the average of the source pixels it covers, weighted by coverage.
+// At upscaling ratios that's at most 2x2 source pixels, the weight (0-32) of the first one is precomputed
+// per output column and line. First pass is horizontal, to a row of spread pixels that we keep around
+// because consecutive output lines share their source lines.
+IRAM_ATTR static void render_area_row(uint32_t *dst, const void *src, const uint16_t *palette, int format,
+                                      int width, int last)
+{
+    #define RENDER_ROW(PTR_TYPE, NATIVE) { \
+        const PTR_TYPE *in = src; \
+        for (int x = 0; x < width; ++x) { \
+            int a = map_viewport_to_source_x[x]; \
+            unsigned w = area_weight_x[x]; \
+            uint32_t pa = AREA_SPREAD(NATIVE(in[a])); \
+            if (w < 32) { \
+                uint32_t pb = AREA_SPREAD(NATIVE(in[RG_MIN(a + 1, last)])); \
+                pa = AREA_BLEND(pa, pb, w); \
+            } \
+            dst[x] = pa; \
+        } \
+    }
+    #define PALETTE_565(v) SWAP_565(palette[v])
+    #define NATIVE_565(v) (v)
+    if (format & RG_PIXEL_PALETTE)
+        RENDER_ROW(uint8_t, PALETTE_565)
+    else if (format == RG_PIXEL_565_LE)
+        RENDER_ROW(uint16_t, NATIVE_565)
+    else
+        RENDER_ROW(uint16_t, SWAP_565)
+    #undef PALETTE_565
+    #undef NATIVE_565
+    #undef RENDER_ROW
+}
+
+static const uint32_t *get_area_row(area_cache_t *cache, const render_state_t *state, int line)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        if (cache->line[i] == line)
+            return cache->rows[i];
+    }
+    int slot = cache->next;
+    cache->next ^= 1;
+    cache->line[slot] = line;
+    render_area_row(cache->rows[slot], state->data + line * state->update->stride, state->update->palette,
+                    state->update->format, state->draw_width, state->update->width - 1 - state->crop_left);
+    return cache->rows[slot];
+}
+
+IRAM_ATTR static void render_area_line(uint16_t *dst, const uint32_t *row0, const uint32_t *row1, unsigned w, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        uint32_t c = (w < 32) ? AREA_BLEND(row0[x], row1[x], w) : row0[x];
+        dst[x] = SWAP_565((c | (c >> 16)) & 0xFFFF);
+    }
+}
+
+// Position of the OSD on screen, relative to the visible part of the viewport
+static void get_osd_position(int *left, int *top)
+{
+    int visible_left = RG_MAX(display.viewport.left, 0);
+    int visible_top = RG_MAX(display.viewport.top, 0);
+    int visible_width = RG_MIN(display.viewport.width, display.screen.width);
+    int visible_height = RG_MIN(display.viewport.height, display.screen.height);
+    *left = visible_left + (osd_left < 0 ? visible_width + osd_left : osd_left);
+    *top = visible_top + (osd_top < 0 ? visible_height + osd_top : osd_top);
+}
+
+// Blends the OSD over a block of lines. `top` is the screen line of the block, `left` the screen column.
+IRAM_ATTR static void draw_osd(const rg_surface_t *surface, uint16_t *buffer, int left, int top, int width, int lines)
+{
+    int osd_x, osd_y;
+    get_osd_position(&osd_x, &osd_y);
+
+    int x_start = RG_MAX(osd_x, left), x_end = RG_MIN(osd_x + surface->width, left + width);
+    int y_start = RG_MAX(osd_y, top), y_end = RG_MIN(osd_y + surface->height, top + lines);
+
+    for (int y = y_start; y < y_end; ++y)
+    {
+        const uint16_t *src = surface->data + surface->offset + (y - osd_y) * surface->stride;
+        uint16_t *dst = buffer + (y - top) * width;
+        for (int x = x_start; x < x_end; ++x)
+        {
+            uint16_t pixel = src[x - osd_x];
+            if (pixel != C_TRANSPARENT)
+                dst[x - left] = SWAP_565(pixel);
+        }
+    }
+}
+
+static void add_osd_damage(int top, int height)
+{
+    int osd_x, osd_y;
+    get_osd_position(&osd_x, &osd_y);
+    int bottom = RG_MIN(osd_y + top + height, display.screen.height);
+    top = RG_MAX(osd_y + top, 0);
+    if (top >= bottom)
+        return;
+    uint32_t prev = __atomic_load_n(&osd_damage, __ATOMIC_RELAXED), next;
+    do
+    {
+        next = (top << 16) | bottom;
+        if (prev)
+            next = (RG_MIN(top, (int)(prev >> 16)) << 16) | RG_MAX(bottom, (int)(prev & 0xFFFF));
+    } while (!__atomic_compare_exchange_n(&osd_damage, &prev, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static line_renderer_t select_line_renderer(int format, int src_width, int dst_width)
+{
+    const line_renderer_t renderers[3][3] = {
+        {&render_line_1x_pal, &render_line_2x_pal, &render_line_scaled_pal},
+        {&render_line_1x_565_be, &render_line_2x_565_be, &render_line_scaled_565_be},
+        {&render_line_1x_565_le, &render_line_2x_565_le, &render_line_scaled_565_le},
+    };
+    int kind = (format & RG_PIXEL_PALETTE) ? 0 : (format == RG_PIXEL_565_LE) ? 2 : 1;
+    int scale = (dst_width == src_width) ? 0 : (dst_width == src_width * 2) ? 1 : 2;
+    return renderers[kind][scale];
+}
+
+// Renders lines [y, y + lines) of the viewport into buffer, returns false if none of them changed.
+// The time spent in each stage is added to stage_time.
+static bool render_block(const render_state_t *state, area_cache_t *cache, uint16_t *line_buffer, int y, int lines,
+                         int32_t *stage_time)
+{
+    const rg_surface_t *update = state->update;
+    const int draw_width = state->draw_width;
+    const int draw_top = state->draw_top;
+    const bool filter_area = state->filter_area;
+    const bool rotated = state->rotated;
+    const int top = y;
+
+    int64_t time_start = rg_system_timer();
+    int64_t time_end;
+
+    // The rotated renderer does the whole block at once, including repeated lines
+    if (rotated)
+        render_block_rotated(line_buffer, update, state->crop_left, state->crop_top, y, lines, draw_width);
+
+    for (int i = 0; i < lines; ++i, ++y)
+    {
+        uint16_t *line_buffer_ptr = line_buffer + i * draw_width;
+
+        if (i > 0 && !filter_area && LINE_IS_REPEATED(y))
+        {
+            if (!rotated)
+                memcpy(line_buffer_ptr, line_buffer_ptr - draw_width, draw_width * 2);
+        }
+        else if (filter_area)
+        {
+            int line = map_viewport_to_source_y[y];
+            int next_line = RG_MIN(line + 1, update->height - 1 - state->crop_top);
+            const uint32_t *row0 = get_area_row(cache, state, line);
+            const uint32_t *row1 = area_weight_y[y] < 32 ? get_area_row(cache, state, next_line) : row0;
+            render_area_line(line_buffer_ptr, row0, row1, area_weight_y[y], draw_width);
+        }
+        else if (!rotated)
+        {
+            line_renderer((uint32_t *)line_buffer_ptr, state->data + map_viewport_to_source_y[y] * update->stride,
+                          update->palette, draw_width);
+        }
+    }
+
+    time_end = rg_system_timer();
+    stage_time[RG_DISPLAY_STAGE_RENDER] += time_end - time_start;
+    time_start = time_end;
+
+    uint32_t checksum = 0xFFFFFFFF;
+    bool need_update = !state->partial_update || state->dirty_lines;
+
+    for (int i = 0; i < lines; ++i)
+    {
+        // Repeated lines are identical to the previous one, no need to hash them again
+        if (state->partial_update && !state->dirty_lines && !(i > 0 && !filter_area && LINE_IS_REPEATED(top + i)))
+            checksum = rg_hash((void*)(line_buffer + i * draw_width), draw_width * 2);
+
+        if (screen_line_checksum[draw_top + top + i] != checksum)
+        {
+            screen_line_checksum[draw_top + top + i] = checksum;
+            need_update = true;
+        }
+    }
+
+    time_end = rg_system_timer();
+    stage_time[RG_DISPLAY_STAGE_CHECKSUM] += time_end - time_start;
+    time_start = time_end;
+
+    if (!need_update)
+        return false;
+
+    if (state->filter_x)
+    {
+        for (int i = 0; i < lines; ++i)
+        {
+            uint16_t *buffer = line_buffer + i * draw_width;
+            for (int x = 1; x < draw_width - 1; ++x)
+            {
+                if (map_viewport_to_source_x[x] == map_viewport_to_source_x[x - 1])
+                {
+                    buffer[x] = blend_pixels(buffer[x - 1], buffer[x + 1]);
+                }
+            }
+        }
+        time_end = rg_system_timer();
+        stage_time[RG_DISPLAY_STAGE_FILTER_X] += time_end - time_start;
+        time_start = time_end;
+    }
+
+    if (state->filter_y)
+    {
+        for (int i = 1; i < lines - 1; ++i)
+        {
+            if (LINE_IS_REPEATED(top + i))
+            {
+                uint16_t *lineA = line_buffer + (i - 1) * draw_width;
+                uint16_t *lineB = line_buffer + (i + 0) * draw_width;
+                uint16_t *lineC = line_buffer + (i + 1) * draw_width;
+                for (size_t x = 0; x < draw_width; ++x)
+                {
+                    lineB[x] = blend_pixels(lineA[x], lineC[x]);
+                }
+            }
+        }
+        time_end = rg_system_timer();
+        stage_time[RG_DISPLAY_STAGE_FILTER_Y] += time_end - time_start;
+    }
+
+    // The OSD can be swapped by another task at any time, it must be read once
+    const rg_surface_t *surface = __atomic_load_n(&osd, __ATOMIC_ACQUIRE);
+    if (surface)
+        draw_osd(surface, line_buffer, state->draw_left, draw_top + top, draw_width, lines);
+
+    return true;
+}
+
+#if RG_SCREEN_PARALLEL_RENDER
+static void render_worker_task(void *arg)
+{
+    rg_task_msg_t msg;
+
+    while (rg_task_receive(&msg))
+    {
+        if (msg.type == RG_TASK_MSG_STOP)
+            break;
+
+        render_job_t *job = msg.dataPtr;
+        job->need_update = render_block(job->state, &area_caches[1], job->buffer, job->y, job->lines, job->stage_time);
+
+        rg_semaphore_give(render_worker_done);
+    }
+}
+#endif
+
+static inline void write_update(const rg_surface_t *update, const uint32_t *dirty_lines)
 {
     const int64_t time_start = rg_system_timer();
+    int32_t stage_time[RG_DISPLAY_STAGE_COUNT] = {0};
+    int64_t stage_start;
 
-    bool filter_x = display.viewport.filter_x;
     bool filter_y = display.viewport.filter_y;
+    bool filter_area = display.viewport.filter_area;
     int draw_left = display.viewport.left;
     int draw_top = display.viewport.top;
     int draw_width = display.viewport.width;
@@ -88,18 +520,89 @@ static inline void write_update(const rg_surface_t *update)
     const uint16_t *palette = update->palette;
 
     const bool partial_update = RG_SCREEN_PARTIAL_UPDATES;
+    const bool rotated = display.viewport.rotation != RG_DISPLAY_ROTATION_OFF;
+
+    // Source lines no longer match output lines when rotating, we can only use the output checksum
+    if (rotated)
+        dirty_lines = NULL;
+
+    // When the core tells us which source lines changed, we can skip rendering and hashing the others entirely.
+    // A line whose checksum is 0 was invalidated (viewport change, write_rect, etc) and must always be redrawn.
+    if (!partial_update)
+        dirty_lines = NULL;
+    else if (dirty_lines)
+        source_palette_checksum = 0; // Our source checksums will be stale after this update
+
+    // Otherwise paletted surfaces are cheaper to check in the 8bit source domain: each visible source line is
+    // hashed once (no matter how many times vertical scaling repeats it) and before being expanded to 16bit.
+    // Get16bits in rg_hash requires 2-byte alignment, we fall back to hashing the output if we don't have it.
+    static uint32_t source_dirty_lines[DIRTY_LINES_MAX / 32];
+    const void *source = update->data + update->offset;
+    if (partial_update && !dirty_lines && !rotated && (format & RG_PIXEL_PALETTE) && update->height <= DIRTY_LINES_MAX &&
+        ((uintptr_t)source & 1) == 0 && (stride & 1) == 0)
+    {
+        stage_start = rg_system_timer();
+        uint32_t palette_checksum = rg_hash((const char *)palette, 256 * 2);
+        bool palette_changed = palette_checksum != source_palette_checksum;
+        int first_line = crop_top + map_viewport_to_source_y[0];
+        int last_line = crop_top + map_viewport_to_source_y[draw_height - 1];
+        if (filter_area) // The last line might also blend with the next one
+            last_line = RG_MIN(last_line + 1, update->height - 1);
+
+        memset(source_dirty_lines, 0, sizeof(source_dirty_lines));
+        for (int line = first_line; line <= last_line; ++line)
+        {
+            uint32_t checksum = rg_hash(source + line * stride, update->width);
+            if (checksum != source_line_checksum[line] || palette_changed)
+            {
+                source_line_checksum[line] = checksum;
+                source_dirty_lines[line >> 5] |= 1u << (line & 31);
+            }
+        }
+        source_palette_checksum = palette_checksum;
+        dirty_lines = source_dirty_lines;
+        stage_time[RG_DISPLAY_STAGE_CHECKSUM] += rg_system_timer() - stage_start;
+    }
+
+    #define SOURCE_LINE_DIRTY(L) (dirty_lines[(L) >> 5] & (1u << ((L) & 31)))
+    #define LINE_NEEDS_UPDATE(Y) (screen_line_checksum[draw_top + (Y)] == 0 || \
+                                  SOURCE_LINE_DIRTY(crop_top + map_viewport_to_source_y[Y]) || \
+                                  (filter_area && area_weight_y[Y] < 32 && \
+                                   SOURCE_LINE_DIRTY(RG_MIN(crop_top + map_viewport_to_source_y[Y] + 1, update->height - 1))))
+
+    // Rows are cached across blocks but the source might have changed since the last update
+    for (int i = 0; i < 2; ++i)
+        area_caches[i].line[0] = area_caches[i].line[1] = -1;
+
+    // The OSD isn't part of the line checksums, lines it touched have to be redrawn
+    uint32_t damage = __atomic_exchange_n(&osd_damage, 0, __ATOMIC_RELAXED);
+    for (int y = damage >> 16; y < (int)(damage & 0xFFFF); ++y)
+        screen_line_checksum[y] = 0;
+
+    render_state = (render_state_t){
+        .update = update,
+        .data = data,
+        .dirty_lines = dirty_lines,
+        .crop_left = crop_left,
+        .crop_top = crop_top,
+        .draw_left = draw_left,
+        .draw_top = draw_top,
+        .draw_width = draw_width,
+        .draw_height = draw_height,
+        .partial_update = partial_update,
+        .rotated = rotated,
+        .filter_x = display.viewport.filter_x,
+        .filter_y = filter_y,
+        .filter_area = filter_area,
+    };
 
+    // First split the viewport in blocks that fit our LCD buffers
     int lines_per_buffer = LCD_BUFFER_LENGTH / draw_width;
-    int lines_remaining = draw_height;
-    int lines_updated = 0;
-    int window_top = -1;
+    int blocks_count = 0;
 
-    for (int y = 0; y < draw_height;)
+    for (int y = 0; y < draw_height && lines_per_buffer > 0;)
     {
-        int lines_to_copy = RG_MIN(lines_per_buffer, lines_remaining);
-
-        if (lines_to_copy < 1)
-            break;
+        int lines_to_copy = RG_MIN(lines_per_buffer, draw_height - y);
 
         // The vertical filter requires a block to start and end with unscaled lines
         if (filter_y)
@@ -109,106 +612,86 @@ static inline void write_update(const rg_surface_t *update)
                 --lines_to_copy;
         }
 
-        uint16_t *line_buffer = lcd_get_buffer(LCD_BUFFER_LENGTH);
-        uint16_t *line_buffer_ptr = line_buffer;
-
-        uint32_t checksum = 0xFFFFFFFF;
-        bool need_update = !partial_update;
-
-        for (int i = 0; i < lines_to_copy; ++i)
+        // Blocks are split the same way as a full update, so filters produce the same result, but
+        // we skip the blocks that contain no dirty line without touching the LCD buffers
+        bool dirty = !dirty_lines;
+        for (int i = 0; i < lines_to_copy && !dirty; ++i)
+            dirty = LINE_NEEDS_UPDATE(y + i);
+        if (dirty)
         {
-            if (i > 0 && LINE_IS_REPEATED(y))
-            {
-                memcpy(line_buffer_ptr, line_buffer_ptr - draw_width, draw_width * 2);
-                line_buffer_ptr += draw_width;
-            }
-            else
-            {
-                #define RENDER_LINE(PTR_TYPE, PIXEL) { \
-                    PTR_TYPE *buffer = (PTR_TYPE *)(data + map_viewport_to_source_y[y] * stride);\
-                    for (int xx = 0; xx < draw_width; ++xx) { \
-                        int x = map_viewport_to_source_x[xx]; \
-                        *line_buffer_ptr++ = (PIXEL); \
-                    } \
-                }
-                if (format & RG_PIXEL_PALETTE)
-                    RENDER_LINE(uint8_t, palette[buffer[x]])
-                else if (format == RG_PIXEL_565_LE)
-                    RENDER_LINE(uint16_t, (buffer[x] << 8) | (buffer[x] >> 8))
-                else
-                    RENDER_LINE(uint16_t, buffer[x])
+            render_blocks[blocks_count][0] = y;
+            render_blocks[blocks_count][1] = lines_to_copy;
+            blocks_count++;
+        }
+        y += lines_to_copy;
+    }
 
-                if (partial_update)
-                {
-                    checksum = rg_hash((void*)(line_buffer_ptr - draw_width), draw_width * 2);
-                }
-            }
+    #undef SOURCE_LINE_DIRTY
+    #undef LINE_NEEDS_UPDATE
 
-            if (screen_line_checksum[draw_top + y] != checksum)
-            {
-                screen_line_checksum[draw_top + y] = checksum;
-                need_update = true;
-            }
+    // Then render them and send them in order. With a render worker, odd blocks are rendered by the worker
+    // while we render even blocks, so two blocks are in flight at once (the LCD drivers must have two buffers).
+    int lines_updated = 0;
+    int window_top = -1;
 
-            ++y;
-        }
+    for (int i = 0; i < blocks_count; ++i)
+    {
+        int y = render_blocks[i][0];
+        int lines = render_blocks[i][1];
+        uint16_t *line_buffer;
+        bool need_update;
 
-        if (filter_x && need_update)
+    #if RG_SCREEN_PARALLEL_RENDER
+        if (i & 1)
         {
-            for (int i = 0; i < lines_to_copy; ++i)
-            {
-                uint16_t *buffer = line_buffer + i * draw_width;
-                for (int x = 1; x < draw_width - 1; ++x)
-                {
-                    if (map_viewport_to_source_x[x] == map_viewport_to_source_x[x - 1])
-                    {
-                        buffer[x] = blend_pixels(buffer[x - 1], buffer[x + 1]);
-                    }
-                }
-            }
+            rg_semaphore_take(render_worker_done, -1);
+            line_buffer = render_worker_job.buffer;
+            need_update = render_worker_job.need_update;
+            // Stages are measured in CPU time, the worker's time is added to ours
+            for (int stage = 0; stage < RG_DISPLAY_STAGE_COUNT; ++stage)
+                stage_time[stage] += render_worker_job.stage_time[stage];
         }
-
-        if (filter_y && need_update)
+        else
         {
-            int top = y - lines_to_copy;
-            for (int i = 1; i < lines_to_copy - 1; ++i)
+            stage_start = rg_system_timer();
+            line_buffer = lcd_get_buffer(LCD_BUFFER_LENGTH);
+            if (i + 1 < blocks_count)
             {
-                if (LINE_IS_REPEATED(top + i))
-                {
-                    uint16_t *lineA = line_buffer + (i - 1) * draw_width;
-                    uint16_t *lineB = line_buffer + (i + 0) * draw_width;
-                    uint16_t *lineC = line_buffer + (i + 1) * draw_width;
-                    for (size_t x = 0; x < draw_width; ++x)
-                    {
-                        lineB[x] = blend_pixels(lineA[x], lineC[x]);
-                    }
-                }
+                render_worker_job = (render_job_t){
+                    .state = &render_state,
+                    .buffer = lcd_get_buffer(LCD_BUFFER_LENGTH),
+                    .y = render_blocks[i + 1][0],
+                    .lines = render_blocks[i + 1][1],
+                };
+                rg_task_send(render_worker_queue, &(rg_task_msg_t){.dataPtr = &render_worker_job});
             }
+            stage_time[RG_DISPLAY_STAGE_SEND] += rg_system_timer() - stage_start;
+            need_update = render_block(&render_state, &area_caches[0], line_buffer, y, lines, stage_time);
         }
-
+    #else
+        stage_start = rg_system_timer();
+        line_buffer = lcd_get_buffer(LCD_BUFFER_LENGTH);
+        stage_time[RG_DISPLAY_STAGE_SEND] += rg_system_timer() - stage_start;
+        need_update = render_block(&render_state, &area_caches[0], line_buffer, y, lines, stage_time);
+    #endif
+
+        stage_start = rg_system_timer();
         if (need_update)
         {
             int left = display.screen.margin_left + draw_left;
-            int top = display.screen.margin_top + draw_top + y - lines_to_copy;
+            int top = display.screen.margin_top + draw_top + y;
             if (top != window_top)
-                lcd_set_window(left, top, draw_width, lines_remaining);
-            lcd_send_buffer(line_buffer, draw_width * lines_to_copy);
-            window_top = top + lines_to_copy;
-            lines_updated += lines_to_copy;
+                lcd_set_window(left, top, draw_width, draw_height - y);
+            lcd_send_buffer(line_buffer, draw_width * lines);
+            window_top = top + lines;
+            lines_updated += lines;
         }
         else
         {
             // Return unused buffer
             lcd_send_buffer(line_buffer, 0);
         }
-
-        lines_remaining -= lines_to_copy;
-    }
-
-    if (osd != NULL)
-    {
-        // TODO: Draw on screen display. By default it should be bottom left which is fine
-        // for both virtual keyboard and info labels. Maybe make it configurable later...
+        stage_time[RG_DISPLAY_STAGE_SEND] += rg_system_timer() - stage_start;
     }
 
     if (lines_updated > draw_height * 0.80f)
@@ -216,6 +699,20 @@ static inline void write_update(const rg_surface_t *update)
     else
         counters.partFrames++;
     counters.busyTime += rg_system_timer() - time_start;
+
+    for (int stage = 0; stage < RG_DISPLAY_STAGE_COUNT; ++stage)
+    {
+        rg_display_stage_t *counter = &counters.stages[stage];
+        int32_t time = stage_time[stage];
+        int bucket = 0;
+        while (bucket < RG_DISPLAY_STAGE_BUCKETS - 1 && time >= (250 << bucket))
+            bucket++;
+        counter->minTime = counter->count ? RG_MIN(counter->minTime, time) : time;
+        counter->maxTime = RG_MAX(counter->maxTime, time);
+        counter->totalTime += time;
+        counter->histogram[bucket]++;
+        counter->count++;
+    }
 }
 
 static void update_viewport_scaling(void)
@@ -224,6 +721,14 @@ static void update_viewport_scaling(void)
     int screen_height = display.screen.height;
     int src_width = display.source.width;
     int src_height = display.source.height;
+
+    // In AUTO mode the core decides, through the flags passed to rg_display_submit
+    display.viewport.rotation = config.rotation == RG_DISPLAY_ROTATION_AUTO ? display.source.rotation : config.rotation;
+    if (display.viewport.rotation != RG_DISPLAY_ROTATION_OFF)
+    {
+        src_width = display.source.height;
+        src_height = display.source.width;
+    }
     int new_width = src_width;
     int new_height = src_height;
 
@@ -263,14 +768,32 @@ static void update_viewport_scaling(void)
                                 (config.scaling && (display.viewport.width % src_width) != 0);
     display.viewport.filter_y = (config.filter == RG_DISPLAY_FILTER_VERT || config.filter == RG_DISPLAY_FILTER_BOTH) &&
                                 (config.scaling && (display.viewport.height % src_height) != 0);
+    // The area filter isn't implemented in the rotated renderer, this is the best we can do for now
+    display.viewport.filter_area = config.filter == RG_DISPLAY_FILTER_AREA && config.scaling &&
+                                   display.viewport.rotation == RG_DISPLAY_ROTATION_OFF;
 
     memset(screen_line_checksum, 0, sizeof(screen_line_checksum));
+    memset(source_line_checksum, 0, sizeof(source_line_checksum));
+
+    line_renderer = select_line_renderer(display.source.format, src_width, new_width);
 
     for (int x = 0; x < screen_width; ++x)
         map_viewport_to_source_x[x] = FLOAT_TO_INT(x * display.viewport.step_x);
     for (int y = 0; y < screen_height; ++y)
         map_viewport_to_source_y[y] = FLOAT_TO_INT(y * display.viewport.step_y);
 
+    // Share of the first source pixel in each output pixel, as 0-32 fixed point
+    for (int x = 0; x < screen_width; ++x)
+    {
+        float weight = (map_viewport_to_source_x[x] + 1 - x * display.viewport.step_x) / display.viewport.step_x;
+        area_weight_x[x] = FLOAT_TO_INT(RG_MIN(RG_MAX(weight, 0.f), 1.f) * 32);
+    }
+    for (int y = 0; y < screen_height; ++y)
+    {
+        float weight = (map_viewport_to_source_y[y] + 1 - y * display.viewport.step_y) / display.viewport.step_y;
+        area_weight_y[y] = FLOAT_TO_INT(RG_MIN(RG_MAX(weight, 0.f), 1.f) * 32);
+    }
+
     RG_LOGI("%dx%d@%.3f => %dx%d@%.3f left:%d top:%d step_x:%.2f step_y:%.2f", src_width, src_height,
             (float)src_width / src_height, new_width, new_height, (float)new_width / new_height,
             display.viewport.left, display.viewport.top, display.viewport.step_x, display.viewport.step_y);
@@ -324,7 +847,9 @@ static void display_task(void *arg)
             display.changed = false;
         }
 
-        write_update(msg.dataPtr);
+        rg_system_trace(RG_TRACE_DISPLAY, true);
+        write_update(msg.dataPtr, msg.type > 0 ? submit_dirty_lines[msg.type - 1] : NULL);
+        rg_system_trace(RG_TRACE_DISPLAY, false);
 
         rg_task_receive(&msg);
 
@@ -399,7 +924,7 @@ display_filter_t rg_display_get_filter(void)
 void rg_display_set_rotation(display_rotation_t rotation)
 {
     config.rotation = RG_MIN(RG_MAX(0, rotation), RG_DISPLAY_ROTATION_COUNT - 1);
-    rg_settings_set_number(NS_APP, SETTING_SCALING, config.rotation);
+    rg_settings_set_number(NS_APP, SETTING_ROTATION, config.rotation);
     display.changed = true;
 }
 
@@ -444,27 +969,74 @@ char *rg_display_get_border(void)
 }
 
 void rg_display_submit(const rg_surface_t *update, uint32_t flags)
+{
+    rg_display_submit_dirty(update, NULL, flags);
+}
+
+void rg_display_submit_dirty(const rg_surface_t *update, const uint32_t *dirty_lines, uint32_t flags)
 {
     const int64_t time_start = rg_system_timer();
+    int rotation = RG_DISPLAY_ROTATION_OFF;
+    int msg_type = 0;
 
     // Those things should probably be asserted, but this is a new system let's be forgiving...
     if (!update || !update->data)
         return;
 
-    if (display.source.width != update->width || display.source.height != update->height)
+    if (flags & RG_DISPLAY_ROTATE_LEFT)
+        rotation = RG_DISPLAY_ROTATION_LEFT;
+    else if (flags & RG_DISPLAY_ROTATE_RIGHT)
+        rotation = RG_DISPLAY_ROTATION_RIGHT;
+
+    if (display.source.width != update->width || display.source.height != update->height ||
+        display.source.format != update->format || display.source.rotation != rotation)
     {
         rg_display_sync(true);
         display.source.width = update->width;
         display.source.height = update->height;
+        display.source.format = update->format;
+        display.source.rotation = rotation;
         display.changed = true;
     }
 
-    rg_task_send(display_task_queue, &(rg_task_msg_t){.dataPtr = update});
+    // The display task might still be reading the previous bitmap, but never the one before that because
+    // our queue only holds one message. So we can alternate between two copies without locking.
+    if (dirty_lines && update->height <= DIRTY_LINES_MAX)
+    {
+        uint32_t *copy = submit_dirty_lines[submit_dirty_slot];
+        size_t words = (update->height + 31) / 32;
+        memcpy(copy, dirty_lines, words * 4);
+        memset(copy + words, 0, sizeof(submit_dirty_lines[0]) - words * 4);
+        msg_type = submit_dirty_slot + 1;
+        submit_dirty_slot ^= 1;
+    }
+
+    rg_task_send(display_task_queue, &(rg_task_msg_t){.type = msg_type, .dataPtr = update});
 
     counters.blockTime += rg_system_timer() - time_start;
     counters.totalFrames++;
 }
 
+void rg_display_set_osd(const rg_surface_t *surface, int left, int top)
+{
+    RG_ASSERT(!surface || surface->format == RG_PIXEL_565_LE, "OSD must be RGB565 LE");
+
+    if (osd)
+        add_osd_damage(0, osd->height);
+    osd_left = left;
+    osd_top = top;
+    __atomic_store_n(&osd, surface, __ATOMIC_RELEASE);
+    if (osd)
+        add_osd_damage(0, osd->height);
+}
+
+void rg_display_osd_damage(int left, int top, int width, int height)
+{
+    // Lines are always sent whole to the LCD, only the vertical extent matters for now
+    if (osd)
+        add_osd_damage(top, height);
+}
+
 bool rg_display_sync(bool block)
 {
     while (block && rg_task_messages_waiting(display_task_queue))
@@ -571,6 +1143,9 @@ void rg_display_clear(uint16_t color_le)
 void rg_display_deinit(void)
 {
     rg_task_send(display_task_queue, &(rg_task_msg_t){.type = RG_TASK_MSG_STOP});
+#if RG_SCREEN_PARALLEL_RENDER
+    rg_task_send(render_worker_queue, &(rg_task_msg_t){.type = RG_TASK_MSG_STOP});
+#endif
     lcd_deinit();
     RG_LOGI("Display terminated.\n");
 }
@@ -600,6 +1175,10 @@ void rg_display_init(void)
     };
     lcd_init();
     display_task_queue = rg_task_create("rg_display", &display_task, NULL, 4 * 1024, RG_TASK_PRIORITY_6, 1);
+#if RG_SCREEN_PARALLEL_RENDER
+    render_worker_done = rg_semaphore_create();
+    render_worker_queue = rg_task_create("rg_display_w", &render_worker_task, NULL, 3 * 1024, RG_TASK_PRIORITY_6, 0);
+#endif
     if (config.border_file)
         load_border_file(config.border_file);
     RG_LOGI("Display ready.\n");
@@ -18,6 +18,7 @@ typedef enum
     RG_DISPLAY_FILTER_HORIZ,
     RG_DISPLAY_FILTER_VERT,
     RG_DISPLAY_FILTER_BOTH,
+    RG_DISPLAY_FILTER_AREA,
     RG_DISPLAY_FILTER_COUNT,
 } display_filter_t;
 
@@ -40,6 +41,8 @@ enum
 {
     RG_DISPLAY_WRITE_NOSYNC = (1 << 0),
     RG_DISPLAY_WRITE_NOSWAP = (1 << 1),
+    RG_DISPLAY_ROTATE_LEFT  = (1 << 2), // rg_display_submit: Rotate the frame if rotation is set to AUTO
+    RG_DISPLAY_ROTATE_RIGHT = (1 << 3), // rg_display_submit: Rotate the frame if rotation is set to AUTO
 };
 
 typedef struct
@@ -52,6 +55,27 @@ typedef struct
     double custom_zoom;
 } rg_display_config_t;
 
+typedef enum
+{
+    RG_DISPLAY_STAGE_RENDER = 0, // Conversion and scaling of the source to LCD format
+    RG_DISPLAY_STAGE_CHECKSUM,   // Source or output lines hashing for partial updates
+    RG_DISPLAY_STAGE_FILTER_X,
+    RG_DISPLAY_STAGE_FILTER_Y,
+    RG_DISPLAY_STAGE_SEND,       // Waiting for free LCD buffers and queuing them (DMA/bus bandwidth)
+    RG_DISPLAY_STAGE_COUNT,
+} display_stage_t;
+
+// Histogram buckets are frames that took <250us, <500us, <1ms, <2ms, <4ms, <8ms, <16ms, and more
+#define RG_DISPLAY_STAGE_BUCKETS 8
+
+typedef struct
+{
+    int32_t count; // Number of updates measured
+    int32_t minTime, maxTime; // Per update, in us
+    int64_t totalTime;
+    int32_t histogram[RG_DISPLAY_STAGE_BUCKETS];
+} rg_display_stage_t;
+
 typedef struct
 {
     int32_t totalFrames;
@@ -59,6 +83,7 @@ typedef struct
     int32_t partFrames;
     int64_t blockTime;
     int64_t busyTime;
+    rg_display_stage_t stages[RG_DISPLAY_STAGE_COUNT];
 } rg_display_counters_t;
 
 typedef struct
@@ -88,11 +113,14 @@ typedef struct
         int top, left;
         int width, height;
         float step_x, step_y;
-        bool filter_x, filter_y;
+        bool filter_x, filter_y, filter_area;
+        display_rotation_t rotation; // Effective rotation, never AUTO
     } viewport;
     struct
     {
         int width, height;
+        int format;
+        display_rotation_t rotation; // Requested by the core for AUTO
     } source;
     bool changed;
 } rg_display_t;
@@ -108,6 +136,18 @@ void rg_display_clear(uint16_t color_le);
 bool rg_display_sync(bool block);
 void rg_display_force_redraw(void);
 void rg_display_submit(const rg_surface_t *update, uint32_t flags);
+// Same as rg_display_submit, but lines whose bit isn't set in dirty_lines are assumed to be unchanged since the
+// last submit and won't be rendered at all. Bit N of dirty_lines[N / 32] is source line N (relative to offset).
+// Lines changed in frames that weren't submitted (frameskip) must be carried over to the next submit.
+void rg_display_submit_dirty(const rg_surface_t *update, const uint32_t *dirty_lines, uint32_t flags);
+// The on screen display is a RGB565_LE surface blended over the game during rg_display_submit, so it doesn't
+// require pausing or a full redraw. C_TRANSPARENT pixels are see-through. Position is relative to the game's
+// visible area, negative values are from the right/bottom edge (so -height is the bottom). NULL hides it.
+// The surface remains owned by the caller and is read by the display task, modify it then call
+// rg_display_osd_damage with the area that changed (in surface coordinates). Hide it and rg_display_sync
+// before freeing it.
+void rg_display_set_osd(const rg_surface_t *surface, int left, int top);
+void rg_display_osd_damage(int left, int top, int width, int height);
 
 rg_display_counters_t rg_display_get_counters(void);
 const rg_display_t *rg_display_get_info(void);
@@ -35,11 +35,21 @@ static struct
     cJSON *theme_obj;
     int font_index;
     bool show_clock;
+    bool show_fps;
+    struct
+    {
+        rg_surface_t *surface;
+        char message[64];
+        int64_t message_expiry;
+        int64_t next_update;
+        bool visible;
+    } osd;
     bool initialized;
 } gui;
 
 #define SETTING_FONTTYPE    "FontType"
 #define SETTING_CLOCK       "Clock"
+#define SETTING_FPS         "ShowFPS"
 #define SETTING_THEME       "Theme"
 #define SETTING_WIFI_ENABLE "Enable"
 #define SETTING_WIFI_SLOT   "Slot"
@@ -115,6 +125,7 @@ void rg_gui_init(void)
     rg_gui_set_font(rg_settings_get_number(NS_GLOBAL, SETTING_FONTTYPE, RG_FONT_VERA_12));
     rg_gui_set_theme(rg_settings_get_string(NS_GLOBAL, SETTING_THEME, NULL));
     gui.show_clock = rg_settings_get_boolean(NS_GLOBAL, SETTING_CLOCK, false);
+    gui.show_fps = rg_settings_get_boolean(NS_GLOBAL, SETTING_FPS, false);
     gui.initialized = true;
 }
 
@@ -643,6 +654,94 @@ void rg_gui_draw_status_bars(void)
     rg_gui_draw_icons();
 }
 
+// The notifications and the FPS counter are drawn in a strip that the display blends over the game, that
+// way they don't need the game to be paused or the screen to be fully redrawn.
+static void draw_osd(const char *text)
+{
+    int height = gui.style.font_height + 2;
+
+    if (!text)
+    {
+        if (gui.osd.visible)
+            rg_display_set_osd(NULL, 0, 0);
+        gui.osd.visible = false;
+        return;
+    }
+
+    if (!gui.osd.surface || gui.osd.surface->height != height) // The font changed
+    {
+        rg_display_set_osd(NULL, 0, 0);
+        rg_display_sync(true);
+        rg_surface_free(gui.osd.surface);
+        gui.osd.surface = rg_surface_create(gui.screen_width, height, RG_PIXEL_565_LE, MEM_ANY);
+        gui.osd.visible = false;
+        if (!gui.osd.surface)
+            return;
+    }
+
+    rg_surface_t *surface = gui.osd.surface;
+    uint16_t *pixels = surface->data;
+    for (size_t i = 0; i < surface->width * surface->height; ++i)
+        pixels[i] = C_TRANSPARENT;
+
+    // Point the regular drawing functions at the strip for the duration of the text
+    uint16_t *screen_buffer = gui.screen_buffer;
+    int screen_width = gui.screen_width, screen_height = gui.screen_height;
+    gui.screen_buffer = pixels;
+    gui.screen_width = surface->width;
+    gui.screen_height = surface->height;
+    rg_gui_draw_text(0, 0, 0, text, C_WHITE, C_BLACK, 0);
+    gui.screen_buffer = screen_buffer;
+    gui.screen_width = screen_width;
+    gui.screen_height = screen_height;
+
+    if (!gui.osd.visible)
+        rg_display_set_osd(surface, 0, 0);
+    else
+        rg_display_osd_damage(0, 0, surface->width, surface->height);
+    gui.osd.visible = true;
+}
+
+void rg_gui_update_osd(void)
+{
+    int64_t now = rg_system_timer();
+
+    if (!gui.initialized || now < gui.osd.next_update)
+        return;
+
+    // The counters are refreshed once per second, there's no point in redrawing more often
+    gui.osd.next_update = now + 1000000;
+
+    if (gui.osd.message_expiry > now)
+    {
+        draw_osd(gui.osd.message);
+        gui.osd.next_update = RG_MIN(gui.osd.next_update, gui.osd.message_expiry);
+    }
+    else if (gui.show_fps && !rg_system_get_app()->isLauncher)
+    {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%d FPS", (int)round(rg_system_get_counters().totalFPS));
+        draw_osd(buffer);
+    }
+    else
+    {
+        draw_osd(NULL);
+    }
+}
+
+void rg_gui_show_notification(const char *format, ...)
+{
+    RG_ASSERT_ARG(format);
+
+    va_list va;
+    va_start(va, format);
+    vsnprintf(gui.osd.message, sizeof(gui.osd.message), format, va);
+    va_end(va);
+    gui.osd.message_expiry = rg_system_timer() + RG_GUI_NOTIFICATION_TIME;
+    gui.osd.next_update = 0;
+    rg_gui_update_osd();
+}
+
 static size_t get_dialog_items_count(const rg_gui_option_t *options)
 {
     if (!options)
@@ -1191,6 +1290,8 @@ static rg_gui_event_t filter_update_cb(rg_gui_option_t *option, rg_gui_event_t e
         strcpy(option->value, _("Vert"));
     if (mode == RG_DISPLAY_FILTER_BOTH)
         strcpy(option->value, _("Both"));
+    if (mode == RG_DISPLAY_FILTER_AREA)
+        strcpy(option->value, _("Smooth"));
 
     return RG_DIALOG_VOID;
 }
@@ -1266,6 +1367,47 @@ static rg_gui_event_t speedup_update_cb(rg_gui_option_t *option, rg_gui_event_t
     return RG_DIALOG_VOID;
 }
 
+static rg_gui_event_t rewind_update_cb(rg_gui_option_t *option, rg_gui_event_t event)
+{
+    const int budgets[] = {0, 128, 256, 512, 1024, 2048};
+    const int count = RG_COUNT(budgets);
+    int current = rg_emu_get_rewind_budget() / 1024;
+    int index = 0;
+    while (index < count - 1 && budgets[index] < current)
+        index++;
+
+    if (event == RG_DIALOG_PREV || event == RG_DIALOG_NEXT)
+    {
+        index = (index + (event == RG_DIALOG_NEXT ? 1 : count - 1)) % count;
+        rg_emu_set_rewind_budget(budgets[index] * 1024);
+    }
+
+    if (budgets[index] == 0)
+        strcpy(option->value, _("Off"));
+    else
+        sprintf(option->value, "%dKB", budgets[index]);
+
+    return RG_DIALOG_VOID;
+}
+
+static rg_gui_event_t run_ahead_update_cb(rg_gui_option_t *option, rg_gui_event_t event)
+{
+    int frames = rg_emu_get_run_ahead();
+
+    if (event == RG_DIALOG_PREV || event == RG_DIALOG_NEXT)
+    {
+        frames = (frames + (event == RG_DIALOG_NEXT ? 1 : RG_RUN_AHEAD_MAX)) % (RG_RUN_AHEAD_MAX + 1);
+        rg_emu_set_run_ahead(frames);
+    }
+
+    if (frames == 0)
+        strcpy(option->value, _("Off"));
+    else
+        sprintf(option->value, "%d", frames);
+
+    return RG_DIALOG_VOID;
+}
+
 static rg_gui_event_t led_indicator_opt_cb(rg_gui_option_t *option, rg_gui_event_t event)
 {
     if (event == RG_DIALOG_PREV || event == RG_DIALOG_NEXT)
@@ -1303,6 +1445,19 @@ static rg_gui_event_t show_clock_cb(rg_gui_option_t *option, rg_gui_event_t even
     return RG_DIALOG_VOID;
 }
 
+static rg_gui_event_t show_fps_cb(rg_gui_option_t *option, rg_gui_event_t event)
+{
+    if (event == RG_DIALOG_PREV || event == RG_DIALOG_NEXT)
+    {
+        gui.show_fps = !gui.show_fps;
+        gui.osd.next_update = 0;
+        rg_settings_set_boolean(NS_GLOBAL, SETTING_FPS, gui.show_fps);
+        return RG_DIALOG_REDRAW;
+    }
+    strcpy(option->value, gui.show_fps ? _("On") : _("Off"));
+    return RG_DIALOG_VOID;
+}
+
 static rg_gui_event_t timezone_cb(rg_gui_option_t *option, rg_gui_event_t event)
 {
     const char utc_offsets[][10] = {"UTC-12:00", "UTC-11:00", "UTC-10:00", "UTC-09:00", "UTC-09:30", "UTC-08:00",
@@ -1400,6 +1555,35 @@ static rg_gui_event_t language_cb(rg_gui_option_t *option, rg_gui_event_t event)
     return RG_DIALOG_VOID;
 }
 
+static rg_gui_event_t rotation_update_cb(rg_gui_option_t *option, rg_gui_event_t event)
+{
+    int max = RG_DISPLAY_ROTATION_COUNT - 1;
+    int mode = rg_display_get_rotation();
+    int prev_mode = mode;
+
+    if (event == RG_DIALOG_PREV && --mode < 0)
+        mode = max;
+    if (event == RG_DIALOG_NEXT && ++mode > max)
+        mode = 0;
+
+    if (mode != prev_mode)
+    {
+        rg_display_set_rotation(mode);
+        return RG_DIALOG_REDRAW;
+    }
+
+    if (mode == RG_DISPLAY_ROTATION_OFF)
+        strcpy(option->value, _("Off"));
+    if (mode == RG_DISPLAY_ROTATION_AUTO)
+        strcpy(option->value, _("Auto"));
+    if (mode == RG_DISPLAY_ROTATION_LEFT)
+        strcpy(option->value, _("Left"));
+    if (mode == RG_DISPLAY_ROTATION_RIGHT)
+        strcpy(option->value, _("Right"));
+
+    return RG_DIALOG_VOID;
+}
+
 static rg_gui_event_t border_update_cb(rg_gui_option_t *option, rg_gui_event_t event)
 {
     if (event == RG_DIALOG_ENTER)
@@ -1564,6 +1748,8 @@ static rg_gui_event_t app_options_cb(rg_gui_option_t *option, rg_gui_event_t eve
 
 void rg_gui_options_menu(void)
 {
+    bool have_rewind = rg_system_get_app()->handlers.saveStateMem != NULL;
+    bool have_run_ahead = rg_system_get_app()->handlers.runFrame != NULL;
     rg_gui_option_t options[16] = {
         #if RG_SCREEN_BACKLIGHT
         {0, _("Brightness"),    "-", RG_DIALOG_FLAG_NORMAL, &brightness_update_cb},
@@ -1576,6 +1762,7 @@ void rg_gui_options_menu(void)
         {0, _("Font type"),     "-", RG_DIALOG_FLAG_NORMAL, &font_type_cb},
         {0, _("Theme"),         "-", RG_DIALOG_FLAG_NORMAL, &theme_cb},
         {0, _("Show clock"),    "-", RG_DIALOG_FLAG_NORMAL, &show_clock_cb},
+        {0, _("Show FPS"),      "-", RG_DIALOG_FLAG_NORMAL, &show_fps_cb},
         {0, _("Timezone"),      "-", RG_DIALOG_FLAG_NORMAL, &timezone_cb},
         {0, _("Language"),      "-", RG_DIALOG_FLAG_NORMAL, &language_cb},
         #ifdef RG_GPIO_LED // Only show disk LED option if disk LED GPIO pin is defined
@@ -1591,8 +1778,11 @@ void rg_gui_options_menu(void)
         {0, _("Scaling"),       "-", RG_DIALOG_FLAG_NORMAL, &scaling_update_cb},
         {0, _("Factor"),        "-", RG_DIALOG_FLAG_HIDDEN, &custom_zoom_cb},
         {0, _("Filter"),        "-", RG_DIALOG_FLAG_NORMAL, &filter_update_cb},
+        {0, _("Rotation"),      "-", RG_DIALOG_FLAG_NORMAL, &rotation_update_cb},
         {0, _("Border"),        "-", RG_DIALOG_FLAG_NORMAL, &border_update_cb},
         {0, _("Speed"),         "-", RG_DIALOG_FLAG_NORMAL, &speedup_update_cb},
+        {0, _("Rewind"),        "-", have_rewind ? RG_DIALOG_FLAG_NORMAL : RG_DIALOG_FLAG_HIDDEN, &rewind_update_cb},
+        {0, _("Run-ahead"),     "-", have_run_ahead ? RG_DIALOG_FLAG_NORMAL : RG_DIALOG_FLAG_HIDDEN, &run_ahead_update_cb},
         // {0, _("Misc options"),  NULL, RG_DIALOG_FLAG_NORMAL, &misc_options_cb},
         {0, _("Emulator options"), NULL, RG_DIALOG_FLAG_NORMAL, &app_options_cb},
         RG_DIALOG_END,
@@ -1669,6 +1859,8 @@ void rg_gui_debug_menu(void)
     char local_time[32], timezone[32], uptime[20];
     char battery_info[25], frame_time[32];
     char app_name[32], network_str[64];
+    char stage_time[RG_DISPLAY_STAGE_COUNT][32];
+    char audio_queue[32], audio_time[32], audio_errors[32], core_time[32];
 
     const rg_gui_option_t options[] = {
         {0, "Screen res", screen_res,   RG_DIALOG_FLAG_NORMAL, NULL},
@@ -1684,6 +1876,15 @@ void rg_gui_debug_menu(void)
         {0, "Uptime    ", uptime,       RG_DIALOG_FLAG_NORMAL, NULL},
         {0, "Battery   ", battery_info, RG_DIALOG_FLAG_NORMAL, NULL},
         {0, "Blit time ", frame_time,   RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, " Render   ", stage_time[RG_DISPLAY_STAGE_RENDER],   RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, " Checksum ", stage_time[RG_DISPLAY_STAGE_CHECKSUM], RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, " Filter X ", stage_time[RG_DISPLAY_STAGE_FILTER_X], RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, " Filter Y ", stage_time[RG_DISPLAY_STAGE_FILTER_Y], RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, " Send     ", stage_time[RG_DISPLAY_STAGE_SEND],     RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, "Core time ", core_time,    RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, "Audio lat.", audio_queue,  RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, "Audio time", audio_time,   RG_DIALOG_FLAG_NORMAL, NULL},
+        {0, "Audio errs", audio_errors, RG_DIALOG_FLAG_NORMAL, NULL},
         RG_DIALOG_SEPARATOR,
         {0, "Overclock", "-", RG_DIALOG_FLAG_NORMAL, &overclock_update_cb},
         {1, "Reboot to firmware", NULL, RG_DIALOG_FLAG_NORMAL, NULL},
@@ -1693,6 +1894,7 @@ void rg_gui_debug_menu(void)
         {5, "Cheats    ", NULL, RG_DIALOG_FLAG_NORMAL, NULL},
         {6, "Crash     ", NULL, RG_DIALOG_FLAG_NORMAL, NULL},
         {7, "Log=debug ", NULL, RG_DIALOG_FLAG_NORMAL, NULL},
+        {8, "Save timeline", NULL, RG_DIALOG_FLAG_NORMAL, NULL},
         RG_DIALOG_END
     };
 
@@ -1714,6 +1916,26 @@ void rg_gui_debug_menu(void)
     }
     else
         snprintf(frame_time, 20, "N/A");
+    for (int i = 0; i < RG_DISPLAY_STAGE_COUNT; ++i)
+    {
+        const rg_display_stage_t *stage = &display_stats.stages[i];
+        if (stage->count > 0)
+        {
+            // avg (min-max) in ms, the histogram is too big for the dialog so it goes to the log
+            snprintf(stage_time[i], 32, "%.2f (%.2f-%.2f)", stage->totalTime / 1000.f / stage->count,
+                     stage->minTime / 1000.f, stage->maxTime / 1000.f);
+            const int32_t *h = stage->histogram;
+            RG_LOGI("Display stage %d: %s histogram: %d %d %d %d %d %d %d %d\n", i, stage_time[i],
+                    (int)h[0], (int)h[1], (int)h[2], (int)h[3], (int)h[4], (int)h[5], (int)h[6], (int)h[7]);
+        }
+        else
+            snprintf(stage_time[i], 32, "N/A");
+    }
+    snprintf(core_time, 32, "emu %d%% draw %d%% snd %d%%", (int)stats.stagePercent[RG_FRAME_STAGE_EMULATE],
+             (int)stats.stagePercent[RG_FRAME_STAGE_PRESENT], (int)stats.stagePercent[RG_FRAME_STAGE_AUDIO]);
+    snprintf(audio_queue, 32, "%dms (queue: %d-%d)", stats.audioLatency / 1000, stats.audioQueuedMin, stats.audioQueuedMax);
+    snprintf(audio_time, 32, "%.1f%% (wait: %.1f%%)", stats.audioCopyPercent, stats.audioBlockedPercent);
+    snprintf(audio_errors, 32, "%d under, %d over", stats.audioUnderruns, stats.audioOverruns);
     snprintf(stack_hwm, 20, "%d", stats.freeStackMain);
     snprintf(heap_free, 20, "%d+%d", stats.freeMemoryInt, stats.freeMemoryExt);
     snprintf(block_free, 20, "%d+%d", stats.freeBlockInt, stats.freeBlockExt);
@@ -1761,6 +1983,9 @@ void rg_gui_debug_menu(void)
     case 7:
         rg_system_set_log_level(RG_LOG_DEBUG);
         break;
+    case 8:
+        rg_system_save_trace(RG_STORAGE_ROOT "/trace.json", 0);
+        break;
     }
 }
 
@@ -1853,7 +2078,7 @@ void rg_gui_game_menu(void)
 
     switch (sel)
     {
-        case 1000: if ((slot = rg_gui_savestate_menu(_("Save"), rom_path)) >= 0) rg_emu_save_state(slot); break;
+        case 1000: if ((slot = rg_gui_savestate_menu(_("Save"), rom_path)) >= 0 && rg_emu_save_state(slot)) rg_gui_show_notification(_("Saved to slot %d"), slot); break;
         case 2000: if ((slot = rg_gui_savestate_menu(_("Save"), rom_path)) >= 0 && rg_emu_save_state(slot)) rg_system_exit(); break;
         case 3001: if ((slot = rg_gui_savestate_menu(_("Load"), rom_path)) >= 0) rg_emu_load_state(slot); break;
         case 3002: rg_emu_reset(false); break;
@@ -114,6 +114,10 @@ void rg_gui_draw_hourglass(void); // This should be moved to system or display..
 void rg_gui_draw_status_bars(void);
 void rg_gui_draw_keyboard(const rg_keyboard_map_t *map, size_t cursor);
 void rg_gui_draw_message(const char *format, ...);
+// Shows a line of text over the game for RG_GUI_NOTIFICATION_TIME, without pausing it
+void rg_gui_show_notification(const char *format, ...);
+// Refreshes the notification and FPS overlay, called by rg_system_tick
+void rg_gui_update_osd(void);
 
 intptr_t rg_gui_dialog(const char *title, const rg_gui_option_t *options, int selected_index);
 bool rg_gui_confirm(const char *title, const char *message, bool default_yes);
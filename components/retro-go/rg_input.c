@@ -221,6 +221,7 @@ static void input_task(void *arg)
 
     while (input_task_running)
     {
+        rg_system_trace(RG_TRACE_INPUT, true);
         if (rg_input_read_gamepad_raw(&state))
         {
             for (int i = 0; i < RG_KEY_COUNT; ++i)
@@ -253,6 +254,7 @@ static void input_task(void *arg)
             battery_state = temp;
             next_battery_update = rg_system_timer() + 2 * 1000000; // update every 2 seconds
         }
+        rg_system_trace(RG_TRACE_INPUT, false);
 
         rg_task_delay(10);
     }
@@ -454,7 +454,11 @@ bool rg_storage_read_file(const char *path, void **data_out, size_t *data_len, u
         return false;
     }
 
-    if (!fread(output_buffer, output_buffer_size, 1, fp))
+    rg_system_trace(RG_TRACE_STORAGE, true);
+    size_t read = fread(output_buffer, output_buffer_size, 1, fp);
+    rg_system_trace(RG_TRACE_STORAGE, false);
+
+    if (!read)
     {
         RG_LOGE("File read failed (%d): '%s'", errno, path);
         fclose(fp);
@@ -489,7 +493,11 @@ bool rg_storage_write_file(const char *path, const void *data_ptr, size_t data_l
         return false;
     }
 
-    if (data_len && !fwrite(data_ptr, data_len, 1, fp))
+    rg_system_trace(RG_TRACE_STORAGE, true);
+    size_t written = data_len ? fwrite(data_ptr, data_len, 1, fp) : 1;
+    rg_system_trace(RG_TRACE_STORAGE, false);
+
+    if (!written)
     {
         RG_LOGE("Fwrite failed (%d): '%s'", errno, path);
         fclose(fp);
@@ -1,3 +1,7 @@
+#if defined(RG_ENABLE_PROFILING) && defined(__linux__)
+#define _GNU_SOURCE // For REG_RIP and SIGEV_THREAD_ID
+#endif
+
 #include "rg_system.h"
 
 #include <sys/time.h>
@@ -19,9 +23,28 @@
 #include <esp_timer.h>
 #include <esp_sleep.h>
 #include <driver/gpio.h>
+#ifdef RG_ENABLE_PROFILING
+#include <esp_freertos_hooks.h>
+#if CONFIG_IDF_TARGET_ARCH_XTENSA || defined(__XTENSA__)
+#include <xtensa/xtensa_context.h>
+#endif
+#endif
 #else
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mutex.h>
+#include <sched.h>
+#if RG_BENCHMARK_FRAMES && defined(__linux__)
+#include <sys/resource.h>
+#endif
+#if defined(RG_ENABLE_PROFILING) && defined(__linux__)
+#include <signal.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid // glibc < 2.41
+#endif
+#endif
 #endif
 
 #define RG_STRUCT_MAGIC 0x12345678
@@ -46,6 +69,8 @@ typedef struct
 {
     int32_t totalFrames, fullFrames, partFrames, ticks;
     int64_t busyTime, updateTime;
+    int64_t audioBusyTime, audioBlockedTime;
+    int64_t stageTime[RG_FRAME_STAGE_COUNT];
 } counters_t;
 
 struct rg_task_s
@@ -58,27 +83,75 @@ struct rg_task_s
     TaskHandle_t handle;
 #else
     rg_task_msg_t msg;
-    int msgWaiting;
+    volatile int msgWaiting;
     SDL_threadID handle;
 #endif
     char name[16];
 };
 
-#ifdef RG_ENABLE_PROFILING
+#if RG_ENABLE_PROFILING == 2
+// Instrumented profiler, see __cyg_profile_func_enter
+typedef struct
+{
+    void *volatile func_ptr;
+    void *caller_ptr;
+    uint32_t num_calls, run_time, self_time;
+} profile_frame_t;
+
+typedef struct
+{
+    profile_frame_t *frame; // NULL if the table was full
+    void *func_ptr;
+    int64_t entered, children;
+} profile_call_t;
+
+// Shadow call stack, claimed by a task on its first call and never released
+typedef struct
+{
+    volatile uintptr_t owner;
+    int depth;
+    profile_call_t calls[32];
+} profile_stack_t;
+
+static struct
+{
+    int64_t time_started;
+    uint32_t total_frames;
+    uint32_t overflow;
+    profile_stack_t stacks[12];
+    profile_frame_t frames[1024];
+} *profile;
+#elif defined(RG_ENABLE_PROFILING)
 typedef struct
 {
     void *func_ptr, *caller_ptr;
     int32_t num_calls, run_time;
-    int64_t enter_time;
 } profile_frame_t;
 
+typedef struct
+{
+    void *pc, *caller;
+} profile_sample_t;
+
+// Filled by the sampler (an interrupt or a signal handler) and emptied by profile_drain
+typedef struct
+{
+    profile_sample_t samples[512];
+    volatile uint32_t head, tail;
+    volatile uint32_t dropped;
+} profile_ring_t;
+
 static struct
 {
     int64_t time_started;
     int32_t total_frames;
+    int32_t period; // us between samples
+    uint32_t overflow;
     rg_mutex_t *lock;
-    profile_frame_t frames[512];
+    profile_frame_t frames[8192];
 } *profile;
+// One per core. Internal memory because the sampler may run while the cache (and PSRAM) is disabled.
+static profile_ring_t *profileRings;
 #endif
 
 // The trace will survive a software reset
@@ -92,12 +165,85 @@ static rg_color_t ledColor = -1;
 static rg_stats_t statistics;
 static rg_app_t app;
 static rg_task_t tasks[8];
+static struct
+{
+    int64_t start;
+    int64_t stageStart;
+    int64_t deadline; // Only with app.timerPacing
+    int32_t stageTime[RG_FRAME_STAGE_COUNT];
+    rg_frame_stage_t stage;
+    int skip; // Frames left to skip before drawing again
+    bool draw;
+    bool slow;
+    bool ahead;         // Run-ahead draws this frame instead
+    void *aheadState;   // Snapshot of the real frame while the run-ahead frames run
+    size_t aheadSize;
+    // Auto frameskip, costs are in us
+    float skipCost;     // Work of a frame that isn't drawn
+    float drawCost;     // Extra work of a frame that is drawn
+    float displayCost;  // Time rg_display spends on a frame, in its own task
+    float pressure;     // How often the display was still busy when we presented
+    int windowFrames;
+    int64_t windowStart;
+    int32_t prevDisplayFrames;
+    int64_t prevDisplayTime;
+    int64_t prevUnderruns;
+} frame;
+
+typedef struct
+{
+    uint32_t offset, size; // Encoded delta in history.ring
+    uint32_t prevSize;     // Size of the state it leads back to
+} rewind_record_t;
+
+// Rewind: `state` is the latest snapshot, each record is the delta that turns a snapshot into the previous one
+static struct
+{
+    size_t budget; // 0 = disabled
+    void *arena;
+    uint32_t *state, *scratch;
+    size_t stateCap, stateSize, scratchUsed;
+    rewind_record_t *records;
+    size_t recordsMax, first, count;
+    uint8_t *ring;
+    size_t ringSize;
+    int counter;    // Frames since the last capture
+    bool dirty;     // The emulation has moved since the last capture
+    bool rewinding; // RG_REWIND_KEY is held
+    bool failed;
+} history;
+
+typedef struct
+{
+    int64_t time;
+    uint8_t event, begin, task, core;
+} trace_event_t;
+
+// Timeline of rg_system_trace() markers, written by every task
+static struct
+{
+    trace_event_t *events; // RG_TRACE_BUFFER_LENGTH
+    volatile uint32_t cursor;
+    volatile bool paused;
+} trace;
+
+#if RG_BENCHMARK_FRAMES
+// Frame times of the benchmark run, a frame being the time between two rg_system_tick()
+static struct
+{
+    int32_t *times;
+    int frames, count;
+    int64_t start, last;
+} bench;
+#endif
 
 static const char *SETTING_BOOT_NAME = "BootName";
 static const char *SETTING_BOOT_ARGS = "BootArgs";
 static const char *SETTING_BOOT_FLAGS = "BootFlags";
 static const char *SETTING_TIMEZONE = "Timezone";
 static const char *SETTING_INDICATOR_MASK = "Indicators";
+static const char *SETTING_REWIND = "Rewind";
+static const char *SETTING_RUN_AHEAD = "RunAhead";
 
 #define logbuf_putc(buf, c) (buf)->console[(buf)->cursor++] = c, (buf)->cursor %= RG_LOGBUF_SIZE;
 #define logbuf_puts(buf, str) for (const char *ptr = str; *ptr; ptr++) logbuf_putc(buf, *ptr);
@@ -180,12 +326,15 @@ static void update_statistics(void)
     const counters_t previous = counters;
 
     rg_display_counters_t display = rg_display_get_counters();
-    // rg_audio_counters_t audio = rg_audio_get_counters();
+    rg_audio_counters_t audio = rg_audio_get_counters();
 
     counters.totalFrames = display.totalFrames;
     counters.fullFrames = display.fullFrames;
     counters.partFrames = display.partFrames;
+    counters.audioBusyTime = audio.busyTime;
+    counters.audioBlockedTime = audio.blockedTime;
     counters.busyTime = statistics.busyTime;
+    memcpy(counters.stageTime, statistics.stageTime, sizeof(counters.stageTime));
     counters.ticks = statistics.ticks;
     counters.updateTime = statistics.lastTick;
 
@@ -212,7 +361,20 @@ static void update_statistics(void)
         statistics.skippedFPS = (ticks - frames) / totalTimeSecs;
         statistics.fullFPS = fullFrames / totalTimeSecs;
         statistics.partialFPS = partFrames / totalTimeSecs;
+
+        float audioBlockedTime = counters.audioBlockedTime - previous.audioBlockedTime;
+        float audioBusyTime = counters.audioBusyTime - previous.audioBusyTime;
+        statistics.audioBlockedPercent = audioBlockedTime / totalTime * 100.f;
+        statistics.audioCopyPercent = (audioBusyTime - audioBlockedTime) / totalTime * 100.f;
+
+        for (int i = 0; i < RG_FRAME_STAGE_COUNT; ++i)
+            statistics.stagePercent[i] = (counters.stageTime[i] - previous.stageTime[i]) / totalTime * 100.f;
     }
+    statistics.audioUnderruns = audio.underruns;
+    statistics.audioOverruns = audio.overruns;
+    statistics.audioQueuedMin = audio.minQueued;
+    statistics.audioQueuedMax = audio.maxQueued;
+    statistics.audioLatency = audio.latency;
     statistics.uptime = rg_system_timer() / 1000000;
 
     update_memory_statistics();
@@ -242,10 +404,351 @@ static void update_indicators(void)
     ledColor = newColor;
 }
 
+#if RG_ENABLE_PROFILING == 2
+// Instrumented profiler: every function compiled with -finstrument-functions reports its entry and exit.
+// Each task keeps its own shadow stack to time the calls, and the (caller, function) table is only ever
+// inserted into (slots are claimed with a CAS) and its counters are updated atomically. So no locks.
+// run_time is inclusive and counted once per outermost call of a pair, self_time excludes the callees
+// and is printed as RGD:PROF:SELF lines after the usual RGD:PROF block.
+
+#define PROFILE_SLOT_BUSY ((void *)1)
+
+NO_PROFILE static void profile_init(void)
+{
+    // Internal memory because the ESP32 can't do atomic operations on PSRAM
+    profile = rg_alloc(sizeof(*profile), MEM_FAST | MEM_NOPANIC);
+    if (!profile)
+    {
+        RG_LOGE("Not enough memory for the profiler, it is disabled.\n");
+        return;
+    }
+    profile->time_started = rg_system_timer();
+}
+
+NO_PROFILE static void profile_update(void)
+{
+    // Nothing is buffered in this mode
+}
+
+NO_PROFILE static profile_stack_t *profile_get_stack(void)
+{
+#if defined(ESP_PLATFORM)
+    uintptr_t owner = (uintptr_t)xTaskGetCurrentTaskHandle();
+#else
+    uintptr_t owner = (uintptr_t)SDL_ThreadID();
+#endif
+    for (size_t i = 0; i < RG_COUNT(profile->stacks); ++i)
+    {
+        profile_stack_t *stack = &profile->stacks[i];
+        if (stack->owner == owner || (stack->owner == 0 && __sync_bool_compare_and_swap(&stack->owner, 0, owner)))
+            return stack;
+    }
+    return NULL;
+}
+
+NO_PROFILE static profile_frame_t *profile_get_frame(void *func_ptr, void *caller_ptr)
+{
+    const size_t mask = RG_COUNT(profile->frames) - 1;
+    size_t index = (((uintptr_t)func_ptr >> 1) ^ ((uintptr_t)caller_ptr * 0x9E3779B1u)) & mask;
+
+    for (size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask)
+    {
+        profile_frame_t *frame = &profile->frames[index];
+        void *slot = frame->func_ptr;
+        if (!slot && __sync_bool_compare_and_swap(&frame->func_ptr, NULL, PROFILE_SLOT_BUSY))
+        {
+            frame->caller_ptr = caller_ptr;
+            __sync_synchronize();
+            frame->func_ptr = func_ptr;
+            __atomic_fetch_add(&profile->total_frames, 1, __ATOMIC_RELAXED);
+            return frame;
+        }
+        // We don't wait on a slot being claimed, at worst a pair ends up in two slots and is printed twice
+        if (slot == func_ptr && frame->caller_ptr == caller_ptr)
+            return frame;
+    }
+    __atomic_fetch_add(&profile->overflow, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+NO_PROFILE void __cyg_profile_func_enter(void *this_fn, void *call_site)
+{
+    profile_stack_t *stack = profile ? profile_get_stack() : NULL;
+    if (!stack)
+        return;
+
+    int depth = stack->depth++;
+    if (depth < RG_COUNT(stack->calls))
+        stack->calls[depth] = (profile_call_t){profile_get_frame(this_fn, call_site), this_fn, rg_system_timer(), 0};
+}
+
+NO_PROFILE void __cyg_profile_func_exit(void *this_fn, void *call_site)
+{
+    profile_stack_t *stack = profile ? profile_get_stack() : NULL;
+    if (!stack || stack->depth == 0)
+        return;
+
+    int depth = stack->depth - 1;
+    if (depth < RG_COUNT(stack->calls))
+    {
+        // A longjmp (the 68K's address errors) skips the exits of the calls it unwinds, drop them
+        while (depth >= 0 && stack->calls[depth].func_ptr != this_fn)
+            depth--;
+        if (depth < 0)
+            return; // Entered before the profiler was started
+    }
+    stack->depth = depth;
+    if (depth >= RG_COUNT(stack->calls))
+        return;
+
+    profile_call_t *call = &stack->calls[depth];
+    int64_t elapsed = rg_system_timer() - call->entered;
+    if (depth > 0)
+        stack->calls[depth - 1].children += elapsed;
+
+    profile_frame_t *frame = call->frame;
+    if (!frame)
+        return;
+
+    // When the same pair is already active further down (recursion), its outer call covers this time
+    bool nested = false;
+    for (int i = 0; i < depth && !nested; ++i)
+        nested = stack->calls[i].frame == frame;
+
+    __atomic_fetch_add(&frame->num_calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&frame->self_time, (uint32_t)(elapsed - call->children), __ATOMIC_RELAXED);
+    if (!nested)
+        __atomic_fetch_add(&frame->run_time, (uint32_t)elapsed, __ATOMIC_RELAXED);
+}
+
+NO_PROFILE void rg_system_dump_profile(void)
+{
+    if (!profile)
+        return;
+
+    int64_t now = rg_system_timer();
+
+    printf("RGD:PROF:BEGIN %d %d\n", (int)profile->total_frames, (int)(now - profile->time_started));
+
+    for (int i = 0; i < RG_COUNT(profile->frames); ++i)
+    {
+        profile_frame_t *frame = &profile->frames[i];
+        void *func_ptr = frame->func_ptr;
+        if (!func_ptr || func_ptr == PROFILE_SLOT_BUSY || !frame->num_calls)
+            continue;
+
+        // The slots are kept because the shadow stacks point to them, only the counters are reset
+        uint32_t num_calls = __atomic_exchange_n(&frame->num_calls, 0, __ATOMIC_RELAXED);
+        uint32_t run_time = __atomic_exchange_n(&frame->run_time, 0, __ATOMIC_RELAXED);
+
+        printf(
+            "RGD:PROF:DATA %p\t%p\t%u\t%u\n",
+            frame->caller_ptr,
+            func_ptr,
+            (unsigned)num_calls,
+            (unsigned)run_time
+        );
+    }
+
+    printf("RGD:PROF:END\n");
+
+    // The exclusive times go after the block, so that the tools parsing RGD:PROF:DATA keep working
+    for (int i = 0; i < RG_COUNT(profile->frames); ++i)
+    {
+        profile_frame_t *frame = &profile->frames[i];
+        void *func_ptr = frame->func_ptr;
+        if (!func_ptr || func_ptr == PROFILE_SLOT_BUSY || !frame->self_time)
+            continue;
+        uint32_t self_time = __atomic_exchange_n(&frame->self_time, 0, __ATOMIC_RELAXED);
+        printf("RGD:PROF:SELF %p\t%p\t%u\n", frame->caller_ptr, func_ptr, (unsigned)self_time);
+    }
+
+    uint32_t overflow = __atomic_exchange_n(&profile->overflow, 0, __ATOMIC_RELAXED);
+    if (overflow)
+        RG_LOGW("Calls lost: %d (table full)\n", (int)overflow);
+
+    profile->time_started = now;
+}
+#elif defined(RG_ENABLE_PROFILING)
+// Statistical profiler: each sample is the interrupted PC and its caller, each entry of the dump is a
+// (caller, pc) pair with the number of samples and the time they represent. The PCs are within
+// functions rather than at their entry, symbolizing them gives the function and the line.
+
+IRAM_ATTR NO_PROFILE static void profile_record(int core, void *pc, void *caller)
+{
+    if (!profileRings)
+        return;
+    profile_ring_t *ring = &profileRings[core];
+    uint32_t head = ring->head;
+    if (head - ring->tail >= RG_COUNT(ring->samples))
+    {
+        ring->dropped++;
+        return;
+    }
+    ring->samples[head % RG_COUNT(ring->samples)] = (profile_sample_t){pc, caller};
+    __sync_synchronize();
+    ring->head = head + 1;
+}
+
+#if defined(ESP_PLATFORM) && (CONFIG_IDF_TARGET_ARCH_XTENSA || defined(__XTENSA__))
+// Xtensa only: the saved context is an XtExcFrame and finding it relies on pxTopOfStack being the first
+// field of the TCB, which FreeRTOS guarantees for its ports. The RISC-V port saves a different frame.
+IRAM_ATTR NO_PROFILE static void profile_tick_hook(void)
+{
+    // The tick interrupted a task whose context was saved on its stack, and the TCB's first field points to it
+    XtExcFrame *frame = *(XtExcFrame **)xTaskGetCurrentTaskHandle();
+    // a0 is the return address, with the caller's window increment in the top two bits
+    profile_record(xPortGetCoreID(), (void *)frame->pc, (void *)((frame->a0 & 0x3FFFFFFF) | 0x40000000));
+}
+#elif defined(__linux__)
+NO_PROFILE static void profile_signal(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+#if defined(__x86_64__)
+    void *pc = (void *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    void *pc = (void *)uc->uc_mcontext.pc;
+#else
+    void *pc = NULL;
+#endif
+    profile_record(0, pc, NULL);
+}
+#endif
+
+NO_PROFILE static void profile_init(void)
+{
+    // The table is too big for the internal RAM, boards without PSRAM just go without the profiler
+    profile = rg_alloc(sizeof(*profile), MEM_SLOW | MEM_NOPANIC);
+    if (!profile)
+    {
+        RG_LOGE("Not enough memory for the profiler, it is disabled.\n");
+        return;
+    }
+    profileRings = rg_alloc(sizeof(profile_ring_t) * 2, MEM_FAST | MEM_NOPANIC);
+    if (!profileRings)
+    {
+        RG_LOGE("Not enough memory for the profiler, it is disabled.\n");
+        free(profile);
+        profile = NULL;
+        return;
+    }
+    profile->lock = rg_mutex_create();
+    profile->time_started = rg_system_timer();
+
+#if defined(ESP_PLATFORM) && (CONFIG_IDF_TARGET_ARCH_XTENSA || defined(__XTENSA__))
+    profile->period = 1000000 / configTICK_RATE_HZ;
+    esp_register_freertos_tick_hook_for_cpu(&profile_tick_hook, 0);
+#if !CONFIG_FREERTOS_UNICORE
+    esp_register_freertos_tick_hook_for_cpu(&profile_tick_hook, 1);
+#endif
+#elif defined(__linux__)
+    // The timer counts the CPU time of the calling thread only, the one that runs the emulator
+    profile->period = 1000000 / RG_PROFILE_RATE;
+    struct sigaction action = {.sa_sigaction = &profile_signal, .sa_flags = SA_SIGINFO | SA_RESTART};
+    struct sigevent event = {.sigev_notify = SIGEV_THREAD_ID, .sigev_signo = SIGPROF};
+    struct itimerspec spec = {{0, profile->period * 1000}, {0, profile->period * 1000}};
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+    timer_t timer;
+    sigaction(SIGPROF, &action, NULL);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0 || timer_settime(timer, 0, &spec, NULL) != 0)
+        RG_LOGE("Unable to start the profiling timer!\n");
+#else
+    RG_LOGW("The sampling profiler isn't supported on this platform.\n");
+#endif
+}
+
+// Must be called with profile->lock held
+NO_PROFILE static void profile_drain(void)
+{
+    const size_t mask = RG_COUNT(profile->frames) - 1;
+
+    for (int core = 0; core < 2; ++core)
+    {
+        profile_ring_t *ring = &profileRings[core];
+        uint32_t head = ring->head;
+        __sync_synchronize();
+        for (uint32_t tail = ring->tail; tail != head; ++tail)
+        {
+            profile_sample_t *sample = &ring->samples[tail % RG_COUNT(ring->samples)];
+            size_t index = (((uintptr_t)sample->pc >> 1) ^ ((uintptr_t)sample->caller * 0x9E3779B1u)) & mask;
+            size_t probe = 0;
+            for (; probe <= mask; ++probe, index = (index + 1) & mask)
+            {
+                profile_frame_t *frame = &profile->frames[index];
+                if (!frame->func_ptr)
+                {
+                    frame->func_ptr = sample->pc;
+                    frame->caller_ptr = sample->caller;
+                    profile->total_frames++;
+                }
+                if (frame->func_ptr == sample->pc && frame->caller_ptr == sample->caller)
+                {
+                    frame->num_calls++;
+                    frame->run_time += profile->period;
+                    break;
+                }
+            }
+            if (probe > mask)
+                profile->overflow++;
+        }
+        ring->tail = head;
+    }
+}
+
+NO_PROFILE static void profile_update(void)
+{
+    if (!profile || !rg_mutex_take(profile->lock, 100))
+        return;
+    profile_drain();
+    rg_mutex_give(profile->lock);
+}
+
+NO_PROFILE void rg_system_dump_profile(void)
+{
+    if (!profile || !rg_mutex_take(profile->lock, 10000))
+        return;
+
+    profile_drain();
+
+    printf("RGD:PROF:BEGIN %d %d\n", profile->total_frames, (int)(rg_system_timer() - profile->time_started));
+
+    for (int i = 0; i < RG_COUNT(profile->frames); ++i)
+    {
+        profile_frame_t *frame = &profile->frames[i];
+        if (!frame->func_ptr)
+            continue;
+
+        printf(
+            "RGD:PROF:DATA %p\t%p\t%u\t%u\n",
+            frame->caller_ptr,
+            frame->func_ptr,
+            frame->num_calls,
+            frame->run_time
+        );
+    }
+
+    printf("RGD:PROF:END\n");
+
+    uint32_t dropped = profileRings[0].dropped + profileRings[1].dropped;
+    if (dropped || profile->overflow)
+        RG_LOGW("Samples lost: %d (rings full), %d (table full)\n", (int)dropped, (int)profile->overflow);
+
+    memset(profile->frames, 0, sizeof(profile->frames));
+    profile->time_started = rg_system_timer();
+    profile->total_frames = 0;
+    profile->overflow = 0;
+
+    rg_mutex_give(profile->lock);
+}
+#endif
+
 static void system_monitor_task(void *arg)
 {
     int64_t nextLoopTime = 0;
     time_t prevTime = time(NULL);
+#ifdef RG_ENABLE_PROFILING
+    int profileSeconds = 0;
+#endif
 
     rg_task_delay(2000);
 
@@ -254,7 +757,14 @@ static void system_monitor_task(void *arg)
         nextLoopTime = rg_system_timer() + 1000000;
         rtcValue = time(NULL);
 
+        rg_system_trace(RG_TRACE_MONITOR, true);
         update_statistics();
+    #ifdef RG_ENABLE_PROFILING
+        if (RG_PROFILE_DUMP_INTERVAL > 0 && ++profileSeconds % RG_PROFILE_DUMP_INTERVAL == 0)
+            rg_system_dump_profile();
+        else
+            profile_update();
+    #endif
         // update_indicators(); // Implicitly called by rg_system_set_indicator below
 
         rg_battery_t battery = rg_input_read_battery();
@@ -275,24 +785,7 @@ static void system_monitor_task(void *arg)
             (int)roundf(statistics.partialFPS),
             (int)roundf(statistics.fullFPS),
             (int)roundf((battery.volts * 1000) ?: battery.level));
-
-        // Auto frameskip
-        if (statistics.ticks > app.tickRate * 2)
-        {
-            float speed = ((float)statistics.totalFPS / app.tickRate) * 100.f / app.speed;
-            // We don't fully go back to 0 frameskip because if we dip below 95% once, we're clearly
-            // borderline in power and going back to 0 is just asking for stuttering...
-            if (speed > 99.f && statistics.busyPercent < 85.f && app.frameskip > 1)
-            {
-                app.frameskip--;
-                RG_LOGI("Reduced frameskip to %d", app.frameskip);
-            }
-            else if (speed < 96.f && statistics.busyPercent > 85.f && app.frameskip < 5)
-            {
-                app.frameskip++;
-                RG_LOGI("Raised frameskip to %d", app.frameskip);
-            }
-        }
+        rg_system_trace(RG_TRACE_MONITOR, false);
 
         if (statistics.lastTick < rg_system_timer() - app.tickTimeout)
         {
@@ -365,14 +858,189 @@ static void platform_init(void)
         gpio_set_level(RG_GPIO_LED, 0);
     #endif
 #elif defined(RG_TARGET_SDL2)
+#if !RG_BENCHMARK_FRAMES // The benchmark reports on stdout
     freopen("stdout.txt", "w", stdout);
     freopen("stderr.txt", "w", stderr);
+#endif
     SDL_SetMainReady();
     if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO) < 0)
         RG_PANIC("SDL Init failed!");
 #endif
 }
 
+static void rewind_free(void)
+{
+    free(history.arena);
+    size_t budget = history.budget;
+    memset(&history, 0, sizeof(history));
+    history.budget = budget;
+}
+
+static bool rewind_alloc(void)
+{
+    if (!app.handlers.saveStateMem || history.budget < 32 * 1024)
+        return false;
+
+    // Falls back to internal memory when there's no PSRAM
+    if (!(history.arena = rg_alloc(history.budget, MEM_SLOW | MEM_NOPANIC)))
+        return false;
+
+    // Both full states and at least as much again for deltas must fit, leave some room for the state to grow
+    size_t size = rg_emu_save_state_mem(history.arena, history.budget / 3);
+    history.stateCap = (size + size / 8 + 64) & ~3;
+    history.recordsMax = RG_MIN(RG_MAX(history.budget / 256, 64), 4096);
+    size_t overhead = history.stateCap * 2 + history.recordsMax * sizeof(rewind_record_t);
+    if (!size || overhead + history.stateCap > history.budget)
+    {
+        RG_LOGW("Rewind budget of %dKB is too small for this state (%dKB)\n", (int)history.budget / 1024, (int)size / 1024);
+        rewind_free();
+        return false;
+    }
+
+    // The probe is our first capture, and rg_alloc zeroes memory so the padding is already right
+    history.stateSize = size;
+    history.state = history.arena;
+    history.scratch = (void *)history.state + history.stateCap;
+    history.records = (void *)history.scratch + history.stateCap;
+    history.ring = (void *)(history.records + history.recordsMax);
+    history.ringSize = history.budget - overhead;
+
+    RG_LOGI("Rewind enabled: state %dKB, %dKB of deltas\n", (int)size / 1024, (int)history.ringSize / 1024);
+    return true;
+}
+
+// The XOR of two close states is mostly zeroes. It's stored as (zeroes << 16 | literals) headers each
+// followed by the literal words. Lone zero words stay in the literal run, a header would cost as much.
+static size_t rewind_encode(uint32_t *out, const uint32_t *delta, size_t words)
+{
+    size_t i = 0, pos = 0;
+    while (i < words)
+    {
+        size_t zeroes = 0, literals = 0;
+        while (i < words && !delta[i] && zeroes < 0xFFFF)
+            i++, zeroes++;
+        if (i == words)
+            break;
+        size_t start = i;
+        while (i < words && literals < 0xFFFF && (delta[i] || (i + 1 < words && delta[i + 1])))
+            i++, literals++;
+        if (out)
+        {
+            out[pos] = zeroes << 16 | literals;
+            memcpy(&out[pos + 1], &delta[start], literals * 4);
+        }
+        pos += 1 + literals;
+    }
+    return pos;
+}
+
+static void rewind_apply(uint32_t *state, const uint32_t *in, size_t words)
+{
+    size_t pos = 0;
+    for (const uint32_t *end = in + words; in < end;)
+    {
+        pos += *in >> 16;
+        for (size_t count = *in++ & 0xFFFF; count > 0; --count)
+            state[pos++] ^= *in++;
+    }
+}
+
+static uint8_t *rewind_reserve(size_t size)
+{
+    if (size > history.ringSize)
+        return NULL;
+
+    #define OLDEST (&history.records[history.first])
+    #define NEWEST (&history.records[(history.first + history.count - 1) % history.recordsMax])
+    #define DROP_OLDEST() (history.first = (history.first + 1) % history.recordsMax, history.count--)
+
+    size_t pos = history.count ? NEWEST->offset + NEWEST->size : 0;
+    if (pos + size > history.ringSize)
+    {
+        // What's left past pos is from the previous lap, so the oldest
+        while (history.count && OLDEST->offset >= pos)
+            DROP_OLDEST();
+        pos = 0;
+    }
+    while (history.count && (history.count == history.recordsMax || (OLDEST->offset >= pos && OLDEST->offset < pos + size)))
+        DROP_OLDEST();
+
+    rewind_record_t *record = &history.records[(history.first + history.count++) % history.recordsMax];
+    record->offset = pos;
+    record->size = size;
+    record->prevSize = history.stateSize;
+
+    #undef OLDEST
+    #undef NEWEST
+    #undef DROP_OLDEST
+
+    return history.ring + pos;
+}
+
+static void rewind_capture(void)
+{
+    if (!history.arena)
+    {
+        if (!history.failed && !rewind_alloc())
+            history.failed = true;
+        return;
+    }
+
+    size_t size = rg_emu_save_state_mem(history.scratch, history.stateCap);
+    if (!size)
+    {
+        // Most likely the state outgrew the room we left it, it would fail every frame from now on
+        RG_LOGE("Rewind capture failed (state larger than %dKB?), rewind disabled\n", (int)history.stateCap / 1024);
+        rewind_free();
+        history.failed = true;
+        return;
+    }
+    // Both buffers must be zero padded for the XOR to cover states of different sizes
+    if (history.scratchUsed > size)
+        memset((void *)history.scratch + size, 0, history.scratchUsed - size);
+
+    size_t words = (RG_MAX(size, history.stateSize) + 3) / 4;
+
+    if (history.stateSize)
+    {
+        // The previous state becomes the delta, then the new one takes its place
+        for (size_t i = 0; i < words; ++i)
+            history.state[i] ^= history.scratch[i];
+        size_t length = rewind_encode(NULL, history.state, words);
+        uint32_t *dest = (uint32_t *)rewind_reserve(length * 4);
+        if (dest)
+            rewind_encode(dest, history.state, words);
+        else
+            history.count = 0;
+    }
+
+    uint32_t *temp = history.state;
+    history.state = history.scratch;
+    history.scratch = temp;
+    history.scratchUsed = words * 4;
+    history.stateSize = size;
+    history.dirty = false;
+}
+
+static bool rewind_step(void)
+{
+    if (!history.stateSize)
+        return false;
+
+    // The first step goes back to the latest capture, the following ones walk the deltas
+    if (!history.dirty && history.count)
+    {
+        rewind_record_t *record = &history.records[(history.first + history.count - 1) % history.recordsMax];
+        rewind_apply(history.state, (uint32_t *)(history.ring + record->offset), record->size / 4);
+        history.stateSize = record->prevSize;
+        history.count--;
+    }
+    history.dirty = false;
+    history.counter = 0;
+
+    return rg_emu_load_state_mem(history.state, history.stateSize);
+}
+
 rg_app_t *rg_system_reinit(int sampleRate, const rg_handlers_t *handlers, void *_unused)
 {
     if (!app.initialized)
@@ -383,6 +1051,13 @@ rg_app_t *rg_system_reinit(int sampleRate, const rg_handlers_t *handlers, void *
         app.handlers = *handlers;
     rg_audio_set_sample_rate(app.sampleRate);
 
+    rewind_free();
+    history.budget = rg_settings_get_number(NS_APP, SETTING_REWIND, RG_REWIND_BUDGET) * 1024;
+    free(frame.aheadState);
+    frame.aheadState = NULL;
+    frame.aheadSize = 0;
+    app.runAhead = app.handlers.runFrame ? rg_settings_get_number(NS_APP, SETTING_RUN_AHEAD, RG_RUN_AHEAD) : 0;
+
     return &app;
 }
 
@@ -454,6 +1129,13 @@ rg_app_t *rg_system_init(int sampleRate, const rg_handlers_t *handlers, void *_u
     app.configNs = rg_settings_get_string(NS_BOOT, SETTING_BOOT_NAME, app.configNs);
     app.bootArgs = rg_settings_get_string(NS_BOOT, SETTING_BOOT_ARGS, app.bootArgs);
     app.bootFlags = rg_settings_get_number(NS_BOOT, SETTING_BOOT_FLAGS, app.bootFlags);
+#if RG_BENCHMARK_FRAMES
+    // Set by tools/build_sdl2.sh bench, there's no launcher to pick the core and the ROM
+    if (getenv("RG_BENCH_APP"))
+        app.configNs = strdup(getenv("RG_BENCH_APP"));
+    if (getenv("RG_BENCH_ROM"))
+        app.bootArgs = strdup(getenv("RG_BENCH_ROM"));
+#endif
     rg_display_init();
     rg_gui_init();
 
@@ -497,12 +1179,27 @@ rg_app_t *rg_system_init(int sampleRate, const rg_handlers_t *handlers, void *_u
     if (handlers)
         app.handlers = *handlers;
 
+    history.budget = rg_settings_get_number(NS_APP, SETTING_REWIND, RG_REWIND_BUDGET) * 1024;
+    app.runAhead = app.handlers.runFrame ? rg_settings_get_number(NS_APP, SETTING_RUN_AHEAD, RG_RUN_AHEAD) : 0;
+
 #ifdef RG_ENABLE_PROFILING
     RG_LOGI("Profiling has been enabled at compile time!\n");
-    profile = rg_alloc(sizeof(*profile), MEM_SLOW);
-    profile->lock = rg_mutex_create();
+    profile_init();
+#endif
+
+#if RG_BENCHMARK_FRAMES
+    // Runs must be comparable, whatever the settings say
+    history.budget = 0;
+    app.runAhead = 0;
+    bench.frames = getenv("RG_BENCH_FRAMES") ? atoi(getenv("RG_BENCH_FRAMES")) : RG_BENCHMARK_FRAMES;
+    bench.frames = RG_MAX(bench.frames, 1);
+    bench.times = rg_alloc(bench.frames * sizeof(int32_t), MEM_ANY);
+    RG_LOGI("Benchmark: running %d frames of '%s' unthrottled\n", bench.frames, app.romPath);
 #endif
 
+    if (RG_TRACE_BUFFER_LENGTH > 0 && !trace.events)
+        trace.events = rg_alloc(RG_TRACE_BUFFER_LENGTH * sizeof(trace_event_t), MEM_SLOW | MEM_NOPANIC);
+
     if (app.lowMemoryMode)
         rg_gui_alert("External memory not detected", "Boot will continue but it will surely crash...");
 
@@ -615,8 +1312,9 @@ bool rg_task_send(rg_task_t *task, const rg_task_msg_t *msg)
     return xQueueSend(task->queue, msg, portMAX_DELAY) == pdTRUE;
 #elif defined(RG_TARGET_SDL2)
     while (task->msgWaiting > 0)
-        continue;
+        sched_yield(); // Don't starve the other tasks when the host has few cores
     task->msg = *msg;
+    __sync_synchronize();
     task->msgWaiting = 1;
     return true;
 #endif
@@ -633,8 +1331,10 @@ bool rg_task_peek(rg_task_msg_t *out)
     success = xQueuePeek(task->queue, out, portMAX_DELAY) == pdTRUE;
 #elif defined(RG_TARGET_SDL2)
     while (task->msgWaiting < 1)
-        continue;
+        sched_yield();
+    __sync_synchronize();
     *out = task->msg;
+    success = true;
 #endif
     // task->blocked = false;
     return success;
@@ -651,9 +1351,11 @@ bool rg_task_receive(rg_task_msg_t *out)
     success = xQueueReceive(task->queue, out, portMAX_DELAY) == pdTRUE;
 #elif defined(RG_TARGET_SDL2)
     while (task->msgWaiting < 1)
-        continue;
+        sched_yield();
+    __sync_synchronize();
     *out = task->msg;
     task->msgWaiting = 0;
+    success = true;
 #endif
     // task->blocked = false;
     return success;
@@ -733,6 +1435,48 @@ bool rg_mutex_take(rg_mutex_t *mutex, int timeoutMS)
 #endif
 }
 
+rg_semaphore_t *rg_semaphore_create(void)
+{
+#if defined(ESP_PLATFORM)
+    return (rg_semaphore_t *)xSemaphoreCreateBinary();
+#elif defined(RG_TARGET_SDL2)
+    return (rg_semaphore_t *)SDL_CreateSemaphore(0);
+#endif
+}
+
+void rg_semaphore_free(rg_semaphore_t *sem)
+{
+    if (!sem) return;
+#if defined(ESP_PLATFORM)
+    vSemaphoreDelete((QueueHandle_t)sem);
+#elif defined(RG_TARGET_SDL2)
+    SDL_DestroySemaphore((SDL_sem *)sem);
+#endif
+}
+
+bool rg_semaphore_give(rg_semaphore_t *sem)
+{
+    RG_ASSERT_ARG(sem);
+#if defined(ESP_PLATFORM)
+    return xSemaphoreGive((QueueHandle_t)sem) == pdPASS;
+#elif defined(RG_TARGET_SDL2)
+    return SDL_SemPost((SDL_sem *)sem) == 0;
+#endif
+}
+
+bool rg_semaphore_take(rg_semaphore_t *sem, int timeoutMS)
+{
+    RG_ASSERT_ARG(sem);
+#if defined(ESP_PLATFORM)
+    int timeout = timeoutMS >= 0 ? pdMS_TO_TICKS(timeoutMS) : portMAX_DELAY;
+    return xSemaphoreTake((QueueHandle_t)sem, timeout) == pdPASS;
+#elif defined(RG_TARGET_SDL2)
+    if (timeoutMS < 0)
+        return SDL_SemWait((SDL_sem *)sem) == 0;
+    return SDL_SemWaitTimeout((SDL_sem *)sem, timeoutMS) == 0;
+#endif
+}
+
 void rg_system_load_time(void)
 {
     time_t time_sec = RG_MAX(rtcValue, RG_BUILD_TIME);
@@ -808,21 +1552,343 @@ int rg_system_get_tick_rate(void)
     return app.tickRate;
 }
 
+#if RG_BENCHMARK_FRAMES
+static int compare_int32(const void *a, const void *b)
+{
+    return *(const int32_t *)a - *(const int32_t *)b;
+}
+
+static void benchmark_tick(int64_t now)
+{
+    // The first tick starts the measurement, loading the ROM isn't part of it
+    if (!bench.start)
+    {
+        bench.start = bench.last = now;
+        return;
+    }
+    bench.times[bench.count++] = now - bench.last;
+    bench.last = now;
+    if (bench.count < bench.frames)
+        return;
+
+    int count = bench.count;
+    double seconds = (now - bench.start) / 1000000.0;
+    qsort(bench.times, count, sizeof(int32_t), compare_int32);
+    long peak_rss = -1;
+#ifdef __linux__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        peak_rss = usage.ru_maxrss; // KB on Linux
+#endif
+
+    printf("RGD:BENCH app=%s rom=%s\n", app.configNs, app.romPath);
+    printf("RGD:BENCH frames=%d time=%.3fs fps=%.2f\n", count, seconds, count / seconds);
+    printf("RGD:BENCH frame_us p50=%d p90=%d p99=%d max=%d\n", (int)bench.times[count / 2],
+           (int)bench.times[count * 90 / 100], (int)bench.times[count * 99 / 100], (int)bench.times[count - 1]);
+    printf("RGD:BENCH memory peak_rss_kb=%ld\n", peak_rss);
+    fflush(stdout);
+    exit(0);
+}
+#endif
+
 void rg_system_tick(int busyTime)
 {
     statistics.lastTick = rg_system_timer();
     statistics.busyTime += busyTime;
     statistics.ticks++;
     // WDT_RELOAD(WDT_TIMEOUT);
+    rg_gui_update_osd();
+#if RG_BENCHMARK_FRAMES
+    benchmark_tick(statistics.lastTick);
+#endif
+}
+
+static void frame_close_stage(int64_t now)
+{
+    int elapsed = now - frame.stageStart;
+    frame.stageTime[frame.stage] += elapsed;
+    statistics.stageTime[frame.stage] += elapsed;
+    frame.stageStart = now;
+}
+
+// The averages rise fast and decay slowly: a burst (mode 7, a big room in Doom) raises the frameskip on
+// the next window, but it takes a sustained calm stretch to give frames back. That asymmetry is what
+// keeps the frameskip from oscillating.
+#define FRAME_EMA(avg, value) ((avg) += ((value) - (avg)) * ((value) > (avg) ? 0.5f : 0.05f))
+#define FRAME_WINDOW 8
+
+static void frame_update_frameskip(int work)
+{
+    // A frame this long was interrupted (PCE opens the menu from its input handler), it says nothing of the load
+    if (work > app.frameTime * 8)
+        return;
+
+    if (frame.draw)
+    {
+        FRAME_EMA(frame.drawCost, RG_MAX(work - frame.skipCost, 0.f));
+        FRAME_EMA(frame.pressure, frame.slow ? 1.f : 0.f);
+    }
+    else
+    {
+        FRAME_EMA(frame.skipCost, work);
+    }
+
+    // Only decide at the end of a drawn frame, so that the skip cycle in progress isn't cut short
+    if (++frame.windowFrames < FRAME_WINDOW || frame.skip > 0)
+        return;
+
+    // A window much longer than expected means that we were paused (menu, loading), not slow
+    int64_t now = rg_system_timer();
+    bool paused = now - frame.windowStart > (int64_t)frame.windowFrames * app.frameTime * 2;
+    frame.windowStart = now;
+    frame.windowFrames = 0;
+
+    rg_display_counters_t display = rg_display_get_counters();
+    if (display.totalFrames > frame.prevDisplayFrames)
+    {
+        float cost = (float)(display.busyTime - frame.prevDisplayTime) / (display.totalFrames - frame.prevDisplayFrames);
+        FRAME_EMA(frame.displayCost, cost);
+    }
+    frame.prevDisplayFrames = display.totalFrames;
+    frame.prevDisplayTime = display.busyTime;
+
+    // Drawing one frame out of N+1 must fit (N+1) * skipCost + drawCost in (N+1) budgets, and the
+    // display must be done with a frame before the next one comes. app.frameTime already accounts for
+    // app.speed so fast forward needs nothing special.
+    float budget = app.frameTime * RG_FRAMESKIP_BUDGET;
+    int skip = RG_FRAMESKIP_MAX;
+    if (frame.skipCost < budget)
+        skip = ceilf(frame.drawCost / (budget - frame.skipCost)) - 1;
+    skip = RG_MAX(skip, (int)ceilf(frame.displayCost / budget) - 1);
+    // Backpressure the estimates missed (shared bus, display task starved of CPU)
+    if (frame.pressure > 0.5f)
+        skip++;
+    // Audio running dry is the clearest sign that we aren't keeping up, whatever the numbers say
+    int64_t underruns = rg_audio_get_counters().underruns;
+    if (underruns > frame.prevUnderruns && !paused)
+        skip = RG_MAX(skip, app.frameskip + 1);
+    frame.prevUnderruns = underruns;
+    // Give frames back one at a time, and not down to 0: once we've needed to skip we're borderline in power,
+    // and drawing every frame again is just asking for stuttering. Apps that start at 0 stay there until then.
+    skip = RG_MAX(skip, app.frameskip - 1);
+    if (app.frameskip > 0)
+        skip = RG_MAX(skip, 1);
+    skip = RG_MIN(RG_MAX(skip, 0), RG_FRAMESKIP_MAX);
+
+    if (skip != app.frameskip)
+    {
+        RG_LOGD("Frameskip %d => %d (skip: %dus, draw: %dus, display: %dus, pressure: %.2f)\n", app.frameskip,
+                skip, (int)frame.skipCost, (int)frame.drawCost, (int)frame.displayCost, frame.pressure);
+        app.frameskip = skip;
+    }
+}
+
+static void frame_run_ahead(void)
+{
+    size_t size = 0;
+    while (!(size = rg_emu_save_state_mem(frame.aheadState, frame.aheadSize)))
+    {
+        // The state size isn't known up front, grow until it fits
+        free(frame.aheadState);
+        frame.aheadSize = frame.aheadSize ? frame.aheadSize * 2 : 32 * 1024;
+        if (frame.aheadSize > 1024 * 1024 || !(frame.aheadState = rg_alloc(frame.aheadSize, MEM_ANY | MEM_NOPANIC)))
+        {
+            RG_LOGE("Unable to snapshot the state, run-ahead disabled\n");
+            frame.aheadState = NULL;
+            frame.aheadSize = 0;
+            app.runAhead = 0;
+            return;
+        }
+    }
+
+    for (int i = 1; i <= app.runAhead; ++i)
+        app.handlers.runFrame(i == app.runAhead);
+
+    if (!rg_emu_load_state_mem(frame.aheadState, size))
+    {
+        RG_LOGE("Unable to restore the state, run-ahead disabled\n");
+        app.runAhead = 0;
+    }
+}
+
+bool rg_system_frame_begin(void)
+{
+    history.rewinding = history.budget && (rg_input_read_gamepad() & RG_REWIND_KEY);
+    if (history.rewinding)
+        rewind_step();
+
+    rg_system_trace(RG_TRACE_FRAME, true);
+    rg_system_trace(RG_TRACE_EMULATE, true);
+    frame.start = frame.stageStart = rg_system_timer();
+    frame.stage = RG_FRAME_STAGE_EMULATE;
+    memset(frame.stageTime, 0, sizeof(frame.stageTime));
+    frame.draw = frame.skip == 0;
+    frame.slow = false;
+    // Skipped frames are never seen, so there's nothing to gain by running ahead of them
+    frame.ahead = frame.draw && app.runAhead > 0 && !history.rewinding;
+    return frame.draw && !frame.ahead;
+}
+
+void rg_system_frame_stage(rg_frame_stage_t stage)
+{
+    RG_ASSERT_ARG(stage >= 0 && stage < RG_FRAME_STAGE_COUNT);
+    if (!frame.start) // Outside of a frame, a callback during rg_emu_load_state for example
+        return;
+    frame_close_stage(rg_system_timer());
+    rg_system_trace((rg_trace_event_t)frame.stage, false);
+    rg_system_trace((rg_trace_event_t)stage, true);
+    frame.stage = stage;
+    // If the display is still busy with the previous frame we can't afford to draw all of them
+    if (stage == RG_FRAME_STAGE_PRESENT && frame.draw)
+        frame.slow |= !rg_display_sync(false);
+}
+
+void rg_system_frame_end(void)
+{
+    if (!frame.start)
+        return;
+
+    if (frame.ahead)
+    {
+        rg_system_frame_stage(RG_FRAME_STAGE_EMULATE);
+        frame_run_ahead();
+    }
+
+    int64_t now = rg_system_timer();
+    frame_close_stage(now);
+    rg_system_trace((rg_trace_event_t)frame.stage, false);
+
+    int frameTime = app.frameTime;
+    int elapsed = now - frame.start;
+    frame.start = 0;
+    bool late = elapsed > frameTime + 1500; // Allow some jitter
+
+    // The audio stage is mostly rg_audio_submit blocking, which is pacing rather than work
+    rg_system_tick(elapsed - frame.stageTime[RG_FRAME_STAGE_AUDIO]);
+
+    if (app.timerPacing && !RG_BENCHMARK_FRAMES)
+    {
+        frame.deadline += frameTime;
+        int sleep = frame.deadline - now;
+        late = sleep < -(frameTime / 2);
+        if (sleep > 0 && sleep <= frameTime)
+            rg_usleep(sleep);
+        // Start over after a pause or a speed change rather than trying to catch up
+        if (sleep > frameTime || sleep < -frameTime)
+            frame.deadline = rg_system_timer();
+    }
+
+#if RG_BENCHMARK_FRAMES
+    // Every frame is drawn, otherwise the results would depend on the frameskip's decisions
+    frame.skip = 0;
+#else
+    frame_update_frameskip(elapsed - frame.stageTime[RG_FRAME_STAGE_AUDIO]);
+
+    if (frame.skip > 0)
+        frame.skip--;
+    else if (app.frameskip > 0)
+        frame.skip = app.frameskip;
+    else if (late || (frame.draw && frame.slow))
+        frame.skip = 1;
+#endif
+
+    // Outside of the frame's time, it's a small cost every few frames that would only confuse the frameskip
+    if (history.budget && !history.rewinding)
+    {
+        history.dirty = true;
+        if (++history.counter >= RG_REWIND_INTERVAL)
+        {
+            history.counter = 0;
+            rewind_capture();
+        }
+    }
+
+    rg_system_trace(RG_TRACE_FRAME, false);
 }
 
-IRAM_ATTR int64_t rg_system_timer(void)
+IRAM_ATTR NO_PROFILE int64_t rg_system_timer(void)
 {
 #if defined(ESP_PLATFORM)
     return esp_timer_get_time();
 #elif defined(RG_TARGET_SDL2)
-    return (SDL_GetPerformanceCounter() * 1000000.f) / SDL_GetPerformanceFrequency();
+    // In double, a float loses the microseconds once the counter gets large
+    return (SDL_GetPerformanceCounter() * 1000000.0) / SDL_GetPerformanceFrequency();
+#endif
+}
+
+IRAM_ATTR void rg_system_trace(rg_trace_event_t event, bool begin)
+{
+    if (!trace.events || trace.paused)
+        return;
+    rg_task_t *task = rg_task_current();
+    uint32_t index = __atomic_fetch_add(&trace.cursor, 1, __ATOMIC_RELAXED) & (RG_TRACE_BUFFER_LENGTH - 1);
+    trace.events[index] = (trace_event_t){
+        .time = rg_system_timer(),
+        .event = event,
+        .begin = begin,
+        .task = task ? task - tasks + 1 : 0,
+#ifdef ESP_PLATFORM
+        .core = xPortGetCoreID(),
 #endif
+    };
+}
+
+// Chrome's trace event format, it opens in ui.perfetto.dev and chrome://tracing
+static bool save_timeline(FILE *fp)
+{
+    static const char *names[RG_TRACE_COUNT] = {
+        [RG_TRACE_EMULATE] = "emulate",
+        [RG_TRACE_PRESENT] = "present",
+        [RG_TRACE_AUDIO] = "audio",
+        [RG_TRACE_FRAME] = "frame",
+        [RG_TRACE_DISPLAY] = "display",
+        [RG_TRACE_DMA_WAIT] = "dma wait",
+        [RG_TRACE_AUDIO_SUBMIT] = "audio submit",
+        [RG_TRACE_STORAGE] = "storage",
+        [RG_TRACE_INPUT] = "input",
+        [RG_TRACE_MONITOR] = "monitor",
+    };
+    int depth[RG_COUNT(tasks) + 1] = {0};
+    int64_t start = 0;
+
+    if (!trace.events)
+        return false;
+
+    // Writers check the flag before they grab a slot, give those that just did time to finish
+    trace.paused = true;
+    rg_task_delay(10);
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}", app.name);
+    fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"(other)\"}}");
+    for (size_t i = 0; i < RG_COUNT(tasks); ++i)
+    {
+        if (tasks[i].name[0])
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    (int)i + 1, tasks[i].name);
+    }
+
+    uint32_t cursor = trace.cursor;
+    uint32_t count = RG_MIN(cursor, RG_TRACE_BUFFER_LENGTH);
+    for (uint32_t i = cursor - count; i != cursor; ++i)
+    {
+        const trace_event_t *e = &trace.events[i & (RG_TRACE_BUFFER_LENGTH - 1)];
+        if (e->event >= RG_TRACE_COUNT || e->task > RG_COUNT(tasks))
+            continue;
+        // The oldest events may be the ends of spans whose beginning was overwritten
+        if (!e->begin && depth[e->task] == 0)
+            continue;
+        depth[e->task] += e->begin ? 1 : -1;
+        if (!start)
+            start = e->time;
+        fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%d,\"args\":{\"core\":%d}}",
+                names[e->event], e->begin ? 'B' : 'E', (long long)(e->time - start), e->task, e->core);
+    }
+
+    fputs("\n]}\n", fp);
+
+    trace.paused = false;
+    return true;
 }
 
 void rg_system_event(int event, void *arg)
@@ -995,6 +2061,15 @@ bool rg_system_save_trace(const char *filename, bool panic_trace)
         return false;
     }
 
+    if (rg_extension_match(filename, "json"))
+    {
+        bool success = save_timeline(fp);
+        fclose(fp);
+        if (!success)
+            RG_LOGE("The timeline is disabled (RG_TRACE_BUFFER_LENGTH).\n");
+        return success;
+    }
+
     rg_stats_t *stats = panic_trace ? &panicTrace.statistics : &statistics;
     fprintf(fp, "Application: %s (%s)\n", app.name, app.configNs);
     fprintf(fp, "Version: %s\n", app.version);
@@ -1234,7 +2309,11 @@ bool rg_emu_load_state(uint8_t slot)
 
     rg_gui_draw_hourglass();
 
-    if (!(success = (*app.handlers.loadState)(filename)))
+    rg_system_trace(RG_TRACE_STORAGE, true);
+    success = (*app.handlers.loadState)(filename);
+    rg_system_trace(RG_TRACE_STORAGE, false);
+
+    if (!success)
     {
         RG_LOGE("Load failed!\n");
     }
@@ -1272,7 +2351,11 @@ bool rg_emu_save_state(uint8_t slot)
 
     #define tempname(ext) strcat(strcpy(tempname, filename), ext)
 
-    if ((*app.handlers.saveState)(tempname(".new")))
+    rg_system_trace(RG_TRACE_STORAGE, true);
+    bool saved = (*app.handlers.saveState)(tempname(".new"));
+    rg_system_trace(RG_TRACE_STORAGE, false);
+
+    if (saved)
     {
         rename(filename, tempname(".bak"));
 
@@ -1308,6 +2391,83 @@ bool rg_emu_save_state(uint8_t slot)
     return success;
 }
 
+size_t rg_emu_save_state_mem(void *buffer, size_t size)
+{
+    if (!app.handlers.saveStateMem || !buffer || !size)
+        return 0;
+    return (*app.handlers.saveStateMem)(buffer, size);
+}
+
+bool rg_emu_load_state_mem(const void *buffer, size_t size)
+{
+    if (!app.handlers.loadStateMem || !buffer || !size)
+        return false;
+    return (*app.handlers.loadStateMem)(buffer, size);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+// Windows has no fmemopen, the stream goes through a temporary file that is copied from/to the buffer.
+// The handlers never open two state streams at once, so one slot is enough.
+static struct
+{
+    FILE *fp;
+    void *buffer;
+    size_t size;
+    bool writing;
+} state_stream;
+#endif
+
+FILE *rg_emu_state_fopen(void *buffer, size_t size, const char *mode)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    RG_ASSERT(state_stream.fp == NULL, "A state stream is already open");
+    FILE *fp = tmpfile();
+    if (!fp)
+    {
+        RG_LOGE("Unable to create a temporary file for the state\n");
+        return NULL;
+    }
+    bool writing = mode[0] != 'r';
+    if (!writing && fwrite(buffer, size, 1, fp) != 1)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    rewind(fp);
+    state_stream.fp = fp;
+    state_stream.buffer = buffer;
+    state_stream.size = size;
+    state_stream.writing = writing;
+#else
+    FILE *fp = fmemopen(buffer, size, mode);
+    // The data is already in RAM, stdio's buffer would only add a copy and delay overflow errors to fclose
+    if (fp)
+        setvbuf(fp, NULL, _IONBF, 0);
+#endif
+    return fp;
+}
+
+size_t rg_emu_state_fclose(FILE *fp)
+{
+    if (!fp)
+        return 0;
+    // Save handlers sometimes seek back to patch a header, the end is the real size
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    bool error = ferror(fp) || size <= 0;
+#if defined(_WIN32) || defined(_WIN64)
+    if (fp == state_stream.fp && state_stream.writing && !error)
+    {
+        // Unlike fmemopen, the file doesn't stop at the buffer's size
+        rewind(fp);
+        error = (size_t)size > state_stream.size || fread(state_stream.buffer, size, 1, fp) != 1;
+    }
+    state_stream.fp = NULL;
+#endif
+    fclose(fp);
+    return error ? 0 : size;
+}
+
 bool rg_emu_screenshot(const char *filename, int width, int height)
 {
     if (!app.handlers.screenshot)
@@ -1395,8 +2555,7 @@ bool rg_emu_reset(bool hard)
 void rg_emu_set_speed(float speed)
 {
     app.speed = RG_MIN(2.5f, RG_MAX(0.5f, speed));
-    // FIXME: We need to store the actual default frameskip so we can return to it...
-    app.frameskip = (app.speed - 0.5f) * 3;
+    // The frameskip isn't touched, rg_system_frame_end() skips more while fast forwarding
     app.frameTime = 1000000.f / (app.tickRate * app.speed);
     rg_audio_set_sample_rate(app.sampleRate * app.speed);
     rg_system_event(RG_EVENT_SPEEDUP, NULL);
@@ -1407,89 +2566,33 @@ float rg_emu_get_speed(void)
     return app.speed;
 }
 
-#ifdef RG_ENABLE_PROFILING
-// Note this profiler might be inaccurate because of:
-// https://gcc.gnu.org/bugzilla/show_bug.cgi?id=28205
-
-// We also need to add multi-core support. Currently it's not an issue
-// because all our profiled code runs on the same core.
-
-#define LOCK_PROFILE()   rg_mutex_take(profile->lock, 10000)
-#define UNLOCK_PROFILE() rg_mutex_give(lock)
-
-NO_PROFILE static inline profile_frame_t *find_frame(void *this_fn, void *call_site)
+bool rg_emu_rewind(void)
 {
-    for (int i = 0; i < 512; ++i)
-    {
-        profile_frame_t *frame = &profile->frames[i];
-        if (frame->func_ptr == 0)
-        {
-            profile->total_frames = RG_MAX(profile->total_frames, i + 1);
-            frame->func_ptr = this_fn;
-        }
-        if (frame->func_ptr == this_fn) // && frame->caller_ptr == call_site)
-            return frame;
-    }
-
-    RG_PANIC("Profile memory exhausted!");
+    return history.arena && rewind_step();
 }
 
-NO_PROFILE void rg_system_dump_profile(void)
+void rg_emu_set_rewind_budget(size_t budget)
 {
-    LOCK_PROFILE();
-
-    printf("RGD:PROF:BEGIN %d %d\n", profile->total_frames, (int)(rg_system_timer() - profile->time_started));
-
-    for (int i = 0; i < profile->total_frames; ++i)
-    {
-        profile_frame_t *frame = &profile->frames[i];
-
-        printf(
-            "RGD:PROF:DATA %p\t%p\t%u\t%u\n",
-            frame->caller_ptr,
-            frame->func_ptr,
-            frame->num_calls,
-            frame->run_time
-        );
-    }
-
-    printf("RGD:PROF:END\n");
-
-    memset(profile->frames, 0, sizeof(profile->frames));
-    profile->time_started = rg_system_timer();
-    profile->total_frames = 0;
-
-    UNLOCK_PROFILE();
+    rewind_free();
+    history.budget = budget;
+    rg_settings_set_number(NS_APP, SETTING_REWIND, budget / 1024);
 }
 
-NO_PROFILE void __cyg_profile_func_enter(void *this_fn, void *call_site)
+size_t rg_emu_get_rewind_budget(void)
 {
-    if (!profile)
-        return;
-
-    int64_t now = rg_system_timer();
-    LOCK_PROFILE();
-    profile_frame_t *fn = find_frame(this_fn, call_site);
-    // Recursion will need a real stack, this is absurd
-    if (fn->enter_time != 0)
-        fn->run_time += now - fn->enter_time;
-    fn->enter_time = rg_system_timer(); // not now, because we delayed execution
-    fn->num_calls++;
-    UNLOCK_PROFILE();
+    return history.budget;
 }
 
-NO_PROFILE void __cyg_profile_func_exit(void *this_fn, void *call_site)
+void rg_emu_set_run_ahead(int frames)
 {
-    if (!profile)
+    if (!app.handlers.runFrame)
         return;
+    app.runAhead = RG_MIN(RG_MAX(frames, 0), RG_RUN_AHEAD_MAX);
+    rg_settings_set_number(NS_APP, SETTING_RUN_AHEAD, app.runAhead);
+}
 
-    int64_t now = rg_system_timer();
-    LOCK_PROFILE();
-    profile_frame_t *fn = find_frame(this_fn, call_site);
-    // Ignore if profiler was disabled when function entered
-    if (fn->enter_time != 0)
-        fn->run_time += now - fn->enter_time;
-    fn->enter_time = 0;
-    UNLOCK_PROFILE();
+int rg_emu_get_run_ahead(void)
+{
+    return app.runAhead;
 }
-#endif
+
@@ -130,6 +130,9 @@ typedef struct
 {
     bool (*loadState)(const char *filename);                         // rg_emu_load_state() handler
     bool (*saveState)(const char *filename);                         // rg_emu_save_state() handler
+    bool (*loadStateMem)(const void *buffer, size_t size);           // rg_emu_load_state_mem() handler
+    size_t (*saveStateMem)(void *buffer, size_t size);               // rg_emu_save_state_mem() handler, returns 0 on failure
+    void (*runFrame)(bool draw);                                     // Emulate a frame without audio, for run-ahead
     bool (*reset)(bool hard);                                        // rg_emu_reset() handler
     bool (*screenshot)(const char *filename, int width, int height); // rg_emu_screenshot() handler
     void (*event)(int event, void *data);                            // listen to retro-go system events
@@ -139,6 +142,30 @@ typedef struct
     void (*about)(rg_gui_option_t *dest);                            // Add extra options to rg_gui_about_menu()
 } rg_handlers_t;
 
+typedef enum
+{
+    RG_FRAME_STAGE_EMULATE = 0, // Running the core, started by rg_system_frame_begin()
+    RG_FRAME_STAGE_PRESENT,     // Handing the frame to rg_display
+    RG_FRAME_STAGE_AUDIO,       // Converting and submitting audio (including the time blocked by rg_audio)
+    RG_FRAME_STAGE_COUNT,
+} rg_frame_stage_t;
+
+// Markers of the timeline saved by rg_system_save_trace("*.json"), the first ones match the frame stages
+typedef enum
+{
+    RG_TRACE_EMULATE = RG_FRAME_STAGE_EMULATE,
+    RG_TRACE_PRESENT = RG_FRAME_STAGE_PRESENT,
+    RG_TRACE_AUDIO = RG_FRAME_STAGE_AUDIO,
+    RG_TRACE_FRAME,        // rg_system_frame_begin to rg_system_frame_end, pacing included
+    RG_TRACE_DISPLAY,      // display_task sending a frame
+    RG_TRACE_DMA_WAIT,     // Waiting for a free SPI buffer
+    RG_TRACE_AUDIO_SUBMIT, // audio_task handing samples to the driver
+    RG_TRACE_STORAGE,      // File reads and writes, save states
+    RG_TRACE_INPUT,        // input_task polling the buttons and battery
+    RG_TRACE_MONITOR,      // system_monitor_task updating the statistics
+    RG_TRACE_COUNT,
+} rg_trace_event_t;
+
 typedef struct
 {
     uint8_t id;
@@ -174,6 +201,8 @@ typedef struct
     int tickRate;
     int frameTime;
     int frameskip;
+    bool timerPacing; // rg_system_frame_end() sleeps to keep frameTime, for cores whose audio doesn't block
+    int runAhead;     // Hidden frames emulated ahead of the displayed one, needs handlers.runFrame
     int overclock;
     int tickTimeout;
     bool lowMemoryMode;
@@ -207,6 +236,15 @@ typedef struct
     int freeBlockInt;
     int freeBlockExt;
     int freeStackMain;
+    float audioBlockedPercent; // Time spent waiting in rg_audio_submit
+    float audioCopyPercent;    // Time spent resampling and copying in rg_audio_submit
+    int audioUnderruns;        // Totals since boot
+    int audioOverruns;
+    int audioQueuedMin;        // Lowest/highest number of queued frames during the last second
+    int audioQueuedMax;
+    int audioLatency;          // Estimated time for a submitted frame to be heard, in microseconds
+    int64_t stageTime[RG_FRAME_STAGE_COUNT];  // Totals reported by the frame scheduler
+    float stagePercent[RG_FRAME_STAGE_COUNT]; // Share of the last second
 } rg_stats_t;
 
 rg_app_t *rg_system_init(int sampleRate, const rg_handlers_t *handlers, void *_unused);
@@ -229,9 +267,17 @@ int  rg_system_get_overclock(void);
 void rg_system_set_log_level(rg_log_level_t level);
 int  rg_system_get_log_level(void);
 void rg_system_tick(int busyTime);
+// Frame scheduler: it decides which frames get drawn (frameskip, fast forward, catching up), paces if
+// requested, and ticks. Call begin/end around each emulated frame and mark the stages in between.
+// With run-ahead the real frame isn't drawn, frame_end() snapshots it, draws app.runAhead frames
+// further through handlers.runFrame and restores the snapshot.
+bool rg_system_frame_begin(void); // Returns true if the frame should be drawn
+void rg_system_frame_stage(rg_frame_stage_t stage);
+void rg_system_frame_end(void);
 void rg_system_vlog(int level, const char *context, const char *format, va_list va);
 void rg_system_log(int level, const char *context, const char *format, ...) __attribute__((format(printf,3,4)));
-bool rg_system_save_trace(const char *filename, bool append);
+bool rg_system_save_trace(const char *filename, bool panic_trace); // A .json filename saves the timeline instead
+void rg_system_trace(rg_trace_event_t event, bool begin);
 void rg_system_event(int event, void *data);
 int64_t rg_system_timer(void);
 rg_app_t *rg_system_get_app(void);
@@ -275,15 +321,35 @@ void rg_mutex_free(rg_mutex_t *mutex);
 bool rg_mutex_give(rg_mutex_t *mutex);
 bool rg_mutex_take(rg_mutex_t *mutex, int timeoutMS);
 
+// Unlike a mutex, a semaphore can be given by a task other than the one waiting on it (completion signal)
+typedef void rg_semaphore_t;
+rg_semaphore_t *rg_semaphore_create(void);
+void rg_semaphore_free(rg_semaphore_t *sem);
+bool rg_semaphore_give(rg_semaphore_t *sem);
+bool rg_semaphore_take(rg_semaphore_t *sem, int timeoutMS);
+
 char *rg_emu_get_path(rg_path_type_t type, const char *arg);
 bool rg_emu_save_state(uint8_t slot);
 bool rg_emu_load_state(uint8_t slot);
+// Snapshots to RAM, no UI and no storage involved. Save returns the size used, or 0 if it failed or didn't fit.
+size_t rg_emu_save_state_mem(void *buffer, size_t size);
+bool rg_emu_load_state_mem(const void *buffer, size_t size);
+// For handlers that serialize through stdio. Close returns the size of the stream, or 0 if there was an error.
+FILE *rg_emu_state_fopen(void *buffer, size_t size, const char *mode);
+size_t rg_emu_state_fclose(FILE *fp);
 bool rg_emu_reset(bool hard);
 bool rg_emu_screenshot(const char *filename, int width, int height);
 rg_emu_states_t *rg_emu_get_states(const char *romPath, size_t slots);
 uint8_t rg_emu_get_last_used_slot(const char *romPath);
 void rg_emu_set_speed(float speed);
 float rg_emu_get_speed(void);
+// Rewind captures a state every RG_REWIND_INTERVAL frames and holding RG_REWIND_KEY walks them back.
+// Snapshots are XOR deltas, run-length encoded, that fit in the budget (bytes, 0 disables it).
+bool rg_emu_rewind(void);
+void rg_emu_set_rewind_budget(size_t budget);
+size_t rg_emu_get_rewind_budget(void);
+void rg_emu_set_run_ahead(int frames);
+int rg_emu_get_run_ahead(void);
 
 /* Utilities */
 
@@ -312,8 +378,11 @@ float rg_emu_get_speed(void);
 #endif
 
 #ifdef RG_ENABLE_PROFILING
+void rg_system_dump_profile(void); // Prints the samples collected since the last dump (RGD:PROF format)
+#if RG_ENABLE_PROFILING == 2
 void __cyg_profile_func_enter(void *this_fn, void *call_site);
 void __cyg_profile_func_exit(void *this_fn, void *call_site);
+#endif
 #define NO_PROFILE __attribute((no_instrument_function))
 #else
 #define NO_PROFILE
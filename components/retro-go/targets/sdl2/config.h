@@ -7,10 +7,14 @@
 // Audio
 #define RG_AUDIO_USE_INT_DAC        0   // 0 = Disable, 1 = GPIO25, 2 = GPIO26, 3 = Both
 #define RG_AUDIO_USE_EXT_DAC        0   // 0 = Disable, 1 = Enable
+#ifndef RG_AUDIO_USE_SDL2 // The benchmark builds without it
 #define RG_AUDIO_USE_SDL2           1   // 0 = Disable, 1 = Enable
+#endif
 
 // Video
+#ifndef RG_SCREEN_DRIVER // The benchmark builds with the dummy driver
 #define RG_SCREEN_DRIVER            99   // 0 = ILI9341
+#endif
 #define RG_SCREEN_HOST              0
 #define RG_SCREEN_SPEED             0
 #define RG_SCREEN_BACKLIGHT         1
@@ -333,6 +333,10 @@ static const char *translations[][RG_LANG_MAX] =
         [RG_LANG_EN] = "Both",
         [RG_LANG_FR] = "Tout"
     },
+    {
+        [RG_LANG_EN] = "Smooth",
+        [RG_LANG_FR] = "Lisse"
+    },
     {
         [RG_LANG_EN] = "Fit",
         [RG_LANG_FR] = "Ajuster"
@@ -345,6 +349,18 @@ static const char *translations[][RG_LANG_MAX] =
         [RG_LANG_EN] = "Zoom",
         [RG_LANG_FR] = "Zoomer"
     },
+    {
+        [RG_LANG_EN] = "Rotation",
+        [RG_LANG_FR] = "Rotation"
+    },
+    {
+        [RG_LANG_EN] = "Left",
+        [RG_LANG_FR] = "Gauche"
+    },
+    {
+        [RG_LANG_EN] = "Right",
+        [RG_LANG_FR] = "Droite"
+    },
 
     // Led options
     {
@@ -443,6 +459,10 @@ static const char *translations[][RG_LANG_MAX] =
         [RG_LANG_EN] = "Show clock",
         [RG_LANG_FR] = "Horloge"
     },
+    {
+        [RG_LANG_EN] = "Show FPS",
+        [RG_LANG_FR] = "Afficher FPS"
+    },
     {
         [RG_LANG_EN] = "Timezone",
         [RG_LANG_FR] = "Fuseau"
@@ -473,6 +493,14 @@ static const char *translations[][RG_LANG_MAX] =
         [RG_LANG_EN] = "Speed",
         [RG_LANG_FR] = "Vitesse"
     },
+    {
+        [RG_LANG_EN] = "Run-ahead",
+        [RG_LANG_FR] = "Anticipation"
+    },
+    {
+        [RG_LANG_EN] = "Rewind",
+        [RG_LANG_FR] = "Rembobiner"
+    },
 
     // about menu
     {
@@ -576,6 +604,10 @@ static const char *translations[][RG_LANG_MAX] =
         [RG_LANG_EN] = "Load",
         [RG_LANG_FR] = "Charger"
     },
+    {
+        [RG_LANG_EN] = "Saved to slot %d",
+        [RG_LANG_FR] = "Sauve dans emplacement %d"
+    },
     // end of rg_gui.c
 
 
@@ -175,6 +175,29 @@ static bool load_state_handler(const char *filename)
     return false;
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    if (!(savestate_fp = rg_emu_state_fopen(buffer, size, "wb")))
+        return 0;
+    savestate_errors = 0;
+    gwenesis_save_state();
+    size_t used = rg_emu_state_fclose(savestate_fp);
+    return savestate_errors == 0 ? used : 0;
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    if (!(savestate_fp = rg_emu_state_fopen((void *)buffer, size, "rb")))
+        return false;
+    savestate_errors = 0;
+    gwenesis_load_state();
+    rg_emu_state_fclose(savestate_fp);
+    if (savestate_errors == 0)
+        return true;
+    reset_emulation();
+    return false;
+}
+
 static bool reset_handler(bool hard)
 {
     reset_emulation();
@@ -202,6 +225,8 @@ void app_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
         .reset = &reset_handler,
         .screenshot = &screenshot_handler,
         .event = &event_handler,
@@ -268,8 +293,6 @@ void app_main(void)
     uint32_t keymap[8] = {RG_KEY_UP, RG_KEY_DOWN, RG_KEY_LEFT, RG_KEY_RIGHT, RG_KEY_A, RG_KEY_B, RG_KEY_SELECT, RG_KEY_START};
     uint32_t joystick = 0, joystick_old;
 
-    int skipFrames = 0;
-
     RG_LOGI("emulation loop\n");
     while (true)
     {
@@ -294,9 +317,7 @@ void app_main(void)
             }
         }
 
-        int64_t startTime = rg_system_timer();
-        bool drawFrame = skipFrames == 0;
-        bool slowFrame = false;
+        bool drawFrame = rg_system_frame_begin();
 
         int lines_per_frame = REG1_PAL ? LINES_PER_FRAME_PAL : LINES_PER_FRAME_NTSC;
         int hint_counter = gwenesis_vdp_regs[10];
@@ -388,34 +409,21 @@ void app_main(void)
 
         if (drawFrame)
         {
+            rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
             for (int i = 0; i < 256; ++i)
                 currentUpdate->palette[i] = (CRAM565[i] << 8) | (CRAM565[i] >> 8);
-            slowFrame = !rg_display_sync(false);
             currentUpdate->width = screen_width;
             currentUpdate->height = screen_height;
             rg_display_submit(currentUpdate, 0);
         }
 
-        rg_system_tick(rg_system_timer() - startTime);
+        rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
 
         if (yfm_enabled || z80_enabled) {
             // TODO: Mix in gwenesis_sn76489_buffer
             rg_audio_submit((void *)gwenesis_ym2612_buffer, AUDIO_BUFFER_LENGTH >> 1);
         }
 
-        if (skipFrames == 0)
-        {
-            int elapsed = rg_system_timer() - startTime;
-            if (app->frameskip > 0)
-                skipFrames = app->frameskip;
-            else if (elapsed > app->frameTime + 1500) // Allow some jitter
-                skipFrames = 1; // (elapsed / frameTime)
-            else if (drawFrame && slowFrame)
-                skipFrames = 1;
-        }
-        else if (skipFrames > 0)
-        {
-            skipFrames--;
-        }
+        rg_system_frame_end();
     }
 }
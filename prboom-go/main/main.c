@@ -49,6 +49,7 @@
 
 #define AUDIO_BUFFER_LENGTH (AUDIO_SAMPLE_RATE / TICRATE + 1)
 #define NUM_MIX_CHANNELS 8
+#define MIX_CHUNK_LENGTH 64
 
 static rg_surface_t *update;
 static rg_app_t *app;
@@ -276,6 +277,9 @@ bool I_AnySoundStillPlaying(void)
 
 static void soundTask(void *arg)
 {
+    static int16_t sfxbuffer[NUM_MIX_CHANNELS][MIX_CHUNK_LENGTH];
+    rg_audio_stream_t streams[NUM_MIX_CHANNELS + 1];
+
     while (1)
     {
         bool haveMusic = snd_MusicVolume > 0 && musicPlaying;
@@ -288,52 +292,45 @@ static void soundTask(void *arg)
 
         if (haveSFX)
         {
-            int16_t *audioBuffer = (int16_t *)mixbuffer;
-            int16_t *audioBufferEnd = audioBuffer + AUDIO_BUFFER_LENGTH * 2;
-            while (audioBuffer < audioBufferEnd)
+            // Each active channel is rendered to its own buffer and mixed with the music. The sources
+            // are averaged over a chunk rather than every sample, they rarely change more often.
+            for (size_t offset = 0; offset < AUDIO_BUFFER_LENGTH; offset += MIX_CHUNK_LENGTH)
             {
-                int totalSample = 0;
-                int totalSources = 0;
-                int sample;
+                size_t count = RG_MIN(AUDIO_BUFFER_LENGTH - offset, MIX_CHUNK_LENGTH);
+                size_t numStreams = 0;
+
+                if (haveMusic)
+                    streams[numStreams++] = (rg_audio_stream_t){(int16_t *)&mixbuffer[offset], 2, 0};
 
                 for (int i = 0; i < NUM_MIX_CHANNELS; i++)
                 {
                     channel_t *chan = &channels[i];
+                    int16_t *out = sfxbuffer[i];
                     if (!chan->sfx)
                         continue;
 
-                    size_t pos = (size_t)(chan->pos++ * chan->factor);
-
-                    if (pos >= chan->sfx->length)
-                    {
-                        chan->sfx = NULL;
-                    }
-                    else if ((sample = chan->sfx->samples[pos]))
+                    for (size_t j = 0; j < count; j++)
                     {
-                        totalSample += sample - 127;
-                        totalSources++;
+                        size_t pos = (size_t)(chan->pos++ * chan->factor);
+                        if (pos >= chan->sfx->length)
+                        {
+                            chan->sfx = NULL;
+                            memset(out + j, 0, (count - j) * sizeof(int16_t));
+                            break;
+                        }
+                        int sample = chan->sfx->samples[pos];
+                        out[j] = sample ? ((sample - 127) << 7) / (16 - snd_SfxVolume) : 0;
                     }
-                }
-
-                totalSample <<= 7;
-                totalSample /= (16 - snd_SfxVolume);
 
-                if (haveMusic)
-                {
-                    totalSample += *audioBuffer;
-                    totalSources += (totalSources == 0);
+                    streams[numStreams++] = (rg_audio_stream_t){out, 1, 0};
                 }
 
-                if (totalSources > 0)
-                    totalSample /= totalSources;
-
-                if (totalSample > 32767)
-                    totalSample = 32767;
-                else if (totalSample < -32768)
-                    totalSample = -32768;
+                // Divided by the number of effects, the music doesn't count toward it (the original weighting)
+                size_t numSFX = numStreams - haveMusic;
+                for (size_t i = 0; i < numStreams; i++)
+                    streams[i].gain = RG_AUDIO_GAIN_UNITY / RG_MAX(numSFX, 1);
 
-                *audioBuffer++ = totalSample;
-                *audioBuffer++ = totalSample;
+                rg_audio_mix(&mixbuffer[offset], streams, numStreams, count);
             }
         }
 
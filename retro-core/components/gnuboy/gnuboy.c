@@ -700,7 +700,7 @@ typedef struct
 } sblock_t;
 
 
-static int do_save_load(const char *file, bool save)
+static int do_save_load(FILE *fp, bool save)
 {
 	uint32_t sav_ver = SAVE_VERSION;
 	const svar_t svars[] =
@@ -785,13 +785,8 @@ static int do_save_load(const char *file, bool save)
 		{NULL, 0},
 	};
 
-	FILE *fp = NULL;
-
 	if (save)
 	{
-		if (!(fp = fopen(file, "wb")))
-			goto _error;
-
 		for (int i = 0; svars[i].ptr; i++)
 		{
 			uint32_t d = 0;
@@ -829,9 +824,6 @@ static int do_save_load(const char *file, bool save)
 	}
 	else
 	{
-		if (!(fp = fopen(file, "rb")))
-			goto _error;
-
 		for (int i = 0; blocks[i].ptr != NULL; i++)
 		{
 			if (fread(blocks[i].ptr, 4096, blocks[i].len, fp) < 1)
@@ -887,14 +879,12 @@ static int do_save_load(const char *file, bool save)
 		gb_hw_updatemap();
 	}
 
-	fclose(fp);
 	free(buf);
 
 	return 0;
 
 _error:
-	if (fp) fclose(fp);
-	if (buf) free(buf);
+	free(buf);
 
 	return -1;
 }
@@ -902,11 +892,31 @@ _error:
 
 int gnuboy_save_state(const char *file)
 {
-	return do_save_load(file, true);
+	FILE *fp = fopen(file, "wb");
+	if (!fp) return -1;
+	int ret = do_save_load(fp, true);
+	fclose(fp);
+	return ret;
 }
 
 
 int gnuboy_load_state(const char *file)
 {
-	return do_save_load(file, false);
+	FILE *fp = fopen(file, "rb");
+	if (!fp) return -1;
+	int ret = do_save_load(fp, false);
+	fclose(fp);
+	return ret;
+}
+
+
+int gnuboy_save_state_fp(FILE *fp)
+{
+	return do_save_load(fp, true);
+}
+
+
+int gnuboy_load_state_fp(FILE *fp)
+{
+	return do_save_load(fp, false);
 }
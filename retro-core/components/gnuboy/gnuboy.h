@@ -127,3 +127,5 @@ int gnuboy_load_sram(const char *file);
 int gnuboy_save_sram(const char *file, bool quick_save);
 int gnuboy_load_state(const char *file);
 int gnuboy_save_state(const char *file);
+int gnuboy_load_state_fp(FILE *fp);
+int gnuboy_save_state_fp(FILE *fp);
@@ -12,14 +12,13 @@
 
 static const char header[16] = "SNES9X_000000002";
 
+// Blocks that follow the header
+#define EXPECTED_CHUNKS 12
 
-bool S9xSaveState(const char *filename)
+
+bool S9xSaveStateFile(FILE *fp)
 {
    int chunks = 0;
-   FILE *fp = NULL;
-
-   if (!(fp = fopen(filename, "wb")))
-      return false;
 
    chunks += fwrite(&header, sizeof(header), 1, fp);
    chunks += fwrite(&CPU, sizeof(CPU), 1, fp);
@@ -35,26 +34,21 @@ bool S9xSaveState(const char *filename)
    chunks += fwrite(IAPU.RAM, 0x10000, 1, fp);
    chunks += fwrite(&SoundData, sizeof(SoundData), 1, fp);
 
-   printf("Saved chunks = %d\n", chunks);
+   if (chunks != 1 + EXPECTED_CHUNKS)
+      printf("Saved chunks = %d\n", chunks);
 
-   fclose(fp);
-
-   return chunks == 13;
+   return chunks == 1 + EXPECTED_CHUNKS;
 }
 
-bool S9xLoadState(const char *filename)
+bool S9xLoadStateFile(FILE *fp)
 {
    uint8_t buffer[512];
    int chunks = 0;
-   FILE *fp = NULL;
-
-   if (!(fp = fopen(filename, "rb")))
-      return false;
 
    if (!fread(buffer, 16, 1, fp) || memcmp(header, buffer, sizeof(header)) != 0)
    {
       printf("Wrong header found\n");
-      goto fail;
+      return false;
    }
 
    // At this point we can't go back and a failure will corrupt the state anyway
@@ -75,7 +69,14 @@ bool S9xLoadState(const char *filename)
    chunks += fread(IAPU.RAM, 0x10000, 1, fp);
    chunks += fread(&SoundData, sizeof(SoundData), 1, fp);
 
-   printf("Loaded chunks = %d\n", chunks);
+   if (chunks != EXPECTED_CHUNKS)
+   {
+      // Part of the state was overwritten, the machine can't be trusted anymore
+      printf("Loaded chunks = %d\n", chunks);
+      IAPU.RAM = IAPU_RAM;
+      S9xReset();
+      return false;
+   }
 
    // Fixing up registers and pointers:
 
@@ -99,10 +100,27 @@ bool S9xLoadState(const char *filename)
    S9xFixCycles();
    S9xReschedule();
 
-   fclose(fp);
    return true;
+}
+
+bool S9xSaveState(const char *filename)
+{
+   FILE *fp = fopen(filename, "wb");
+   if (!fp)
+      return false;
+
+   bool ret = S9xSaveStateFile(fp);
+   fclose(fp);
+   return ret;
+}
+
+bool S9xLoadState(const char *filename)
+{
+   FILE *fp = fopen(filename, "rb");
+   if (!fp)
+      return false;
 
-fail:
+   bool ret = S9xLoadStateFile(fp);
    fclose(fp);
-   return false;
+   return ret;
 }
@@ -2,6 +2,9 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 bool S9xSaveState(const char *filename);
 bool S9xLoadState(const char *filename);
+bool S9xSaveStateFile(FILE *fp);
+bool S9xLoadStateFile(FILE *fp);
@@ -3,17 +3,12 @@
 #include <sys/time.h>
 #include <gnuboy.h>
 
-static int skipFrames = 0;
-static bool slowFrame = false;
-
-static int video_time;
-static int audio_time;
-
 static const char *sramFile;
 static int autoSaveSRAM = 0;
 static int autoSaveSRAM_Timer = 0;
 static bool useSystemTime = true;
 static bool loadBIOSFile = false;
+static bool runningAhead = false;
 
 static rg_app_t *app;
 static rg_surface_t *updates[2];
@@ -68,19 +63,42 @@ static bool load_state_handler(const char *filename)
 
     update_rtc_time();
 
-    skipFrames = 0;
     autoSaveSRAM_Timer = 0;
 
     // TO DO: Call rtc_sync() if a physical RTC is present
     return true;
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen(buffer, size, "wb");
+    bool success = fp && gnuboy_save_state_fp(fp) == 0;
+    size_t used = rg_emu_state_fclose(fp);
+    return success ? used : 0;
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen((void *)buffer, size, "rb");
+    if (!fp)
+        return false;
+    bool success = gnuboy_load_state_fp(fp) == 0;
+    rg_emu_state_fclose(fp);
+    if (!success)
+    {
+        gnuboy_reset(true);
+        gnuboy_load_sram(sramFile);
+        update_rtc_time();
+    }
+    // The snapshot's RTC is kept as is, unlike load_state_handler we're going back in emulated time
+    return success;
+}
+
 static bool reset_handler(bool hard)
 {
     gnuboy_reset(hard);
     update_rtc_time();
 
-    skipFrames = 0;
     autoSaveSRAM_Timer = 0;
 
     return true;
@@ -218,18 +236,31 @@ static rg_gui_event_t rtc_update_cb(rg_gui_option_t *option, rg_gui_event_t even
 
 static void video_callback(void *buffer)
 {
-    int64_t startTime = rg_system_timer();
-    slowFrame = !rg_display_sync(false);
+    rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
     rg_display_submit(currentUpdate, 0);
-    video_time += rg_system_timer() - startTime;
+    rg_system_frame_stage(RG_FRAME_STAGE_EMULATE);
 }
 
 
 static void audio_callback(void *buffer, size_t length)
 {
-    int64_t startTime = rg_system_timer();
+    if (runningAhead)
+        return;
+    rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
     rg_audio_submit(buffer, length >> 1);
-    audio_time += rg_system_timer() - startTime;
+    rg_system_frame_stage(RG_FRAME_STAGE_EMULATE);
+}
+
+static void run_frame_handler(bool draw)
+{
+    if (draw)
+    {
+        currentUpdate = updates[currentUpdate == updates[0]];
+        gnuboy_set_framebuffer(currentUpdate->data);
+    }
+    runningAhead = true;
+    gnuboy_run(draw);
+    runningAhead = false;
 }
 
 static void options_handler(rg_gui_option_t *dest)
@@ -246,6 +277,9 @@ void gbc_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
+        .runFrame = &run_frame_handler,
         .reset = &reset_handler,
         .screenshot = &screenshot_handler,
         .event = &event_handler,
@@ -345,10 +379,7 @@ void gbc_main(void)
             joystick_old = joystick;
         }
 
-        int64_t startTime = rg_system_timer();
-        bool drawFrame = !skipFrames;
-
-        video_time = audio_time = 0;
+        bool drawFrame = rg_system_frame_begin();
 
         if (drawFrame)
         {
@@ -372,22 +403,6 @@ void gbc_main(void)
             }
         }
 
-        // Tick before submitting audio/syncing
-        rg_system_tick(rg_system_timer() - startTime - audio_time);
-
-        if (skipFrames == 0)
-        {
-            int elapsed = rg_system_timer() - startTime;
-            if (app->frameskip > 0)
-                skipFrames = app->frameskip;
-            else if (elapsed > app->frameTime + 1500) // Allow some jitter
-                skipFrames = 1; // (elapsed / frameTime)
-            else if (drawFrame && slowFrame)
-                skipFrames = 1;
-        }
-        else if (skipFrames > 0)
-        {
-            skipFrames--;
-        }
+        rg_system_frame_end();
     }
 }
@@ -5,7 +5,6 @@
 static int overscan = true;
 static int autocrop = 0;
 static int palette = 0;
-static bool slowFrame = false;
 static bool nsfPlayer = false;
 static nes_t *nes;
 
@@ -51,6 +50,37 @@ static bool load_state_handler(const char *filename)
     return true;
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen(buffer, size, "wb");
+    bool success = fp && state_save_fp(fp) == 0;
+    size_t used = rg_emu_state_fclose(fp);
+    return success ? used : 0;
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen((void *)buffer, size, "rb");
+    if (!fp)
+        return false;
+    bool success = state_load_fp(fp) == 0;
+    rg_emu_state_fclose(fp);
+    if (!success)
+        nes_reset(true);
+    return success;
+}
+
+static void run_frame_handler(bool draw)
+{
+    // The audio is left in the APU buffer, the main loop has already submitted the real frame's
+    if (draw && !nsfPlayer)
+    {
+        currentUpdate = updates[currentUpdate == updates[0]];
+        nes_setvidbuf(currentUpdate->data);
+    }
+    nes_emulate(draw && !nsfPlayer);
+}
+
 static bool reset_handler(bool hard)
 {
     nes_reset(hard);
@@ -150,7 +180,7 @@ static rg_gui_event_t palette_update_cb(rg_gui_option_t *option, rg_gui_event_t
 
 static void blit_screen(uint8 *bmp)
 {
-    slowFrame = bmp && !rg_display_sync(false);
+    rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
     // A rolling average should be used for autocrop == 1, it causes jitter in some games...
     // int crop_h = (autocrop == 2) || (autocrop == 1 && nes->ppu->left_bg_counter > 210) ? 8 : 0;
     int crop_v = (overscan) ? nes->overscan : 0;
@@ -193,6 +223,9 @@ void nes_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
+        .runFrame = &run_frame_handler,
         .reset = &reset_handler,
         .event = &event_handler,
         .screenshot = &screenshot_handler,
@@ -257,7 +290,7 @@ void nes_main(void)
 
     rg_system_set_tick_rate(nes->refresh_rate);
 
-    int skipFrames = 0;
+    int nsfFrames = 0;
 
     while (true)
     {
@@ -271,8 +304,7 @@ void nes_main(void)
                 rg_gui_options_menu();
         }
 
-        int64_t startTime = rg_system_timer();
-        bool drawFrame = !skipFrames && !nsfPlayer;
+        bool drawFrame = rg_system_frame_begin() && !nsfPlayer;
         int buttons = 0;
 
         if (joystick & RG_KEY_START)  buttons |= NES_PAD_START;
@@ -293,29 +325,16 @@ void nes_main(void)
         input_update(0, buttons);
         nes_emulate(drawFrame);
 
-        // Tick before submitting audio/syncing
-        rg_system_tick(rg_system_timer() - startTime);
+        rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
 
         // Audio is used to pace emulation :)
         rg_audio_submit((void*)nes->apu->buffer, nes->apu->samples_per_frame);
 
-        if (skipFrames == 0)
-        {
-            int frameTime = 1000000 / (nes->refresh_rate * app->speed);
-            int elapsed = rg_system_timer() - startTime;
-            if (nsfPlayer)
-                skipFrames = 10, nsf_draw_overlay();
-            else if (app->frameskip > 0)
-                skipFrames = app->frameskip;
-            else if (elapsed > frameTime + 1500) // Allow some jitter
-                skipFrames = 1; // (elapsed / frameTime)
-            else if (drawFrame && slowFrame)
-                skipFrames = 1;
-        }
-        else if (skipFrames > 0)
-        {
-            skipFrames--;
-        }
+        // The player only needs its overlay refreshed now and then
+        if (nsfPlayer && nsfFrames++ % 10 == 0)
+            nsf_draw_overlay();
+
+        rg_system_frame_end();
     }
 
     RG_PANIC("Nofrendo died!");
@@ -14,9 +14,7 @@
 
 static bool emulationPaused = false; // This should probably be a mutex
 static int overscan = false;
-static int skipFrames = 0;
 static bool drawFrame = true;
-static bool slowFrame = false;
 
 static rg_app_t *app;
 static rg_surface_t *updates[2];
@@ -52,54 +50,16 @@ uint8_t *osd_gfx_framebuffer(int width, int height)
 
 void osd_vsync(void)
 {
-    static int64_t lasttime, prevtime;
-
     if (drawFrame)
     {
-        slowFrame = !rg_display_sync(false);
+        rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
         rg_display_submit(currentUpdate, 0);
         currentUpdate = updates[currentUpdate == updates[0]];
     }
 
-    // See if we need to skip a frame to keep up
-    if (skipFrames == 0)
-    {
-        if (app->frameskip > 0)
-            skipFrames = app->frameskip;
-        else if (drawFrame && slowFrame)
-            skipFrames = 1;
-    }
-    else if (skipFrames > 0)
-    {
-        skipFrames--;
-    }
-
-    int64_t curtime = rg_system_timer();
-    int frameTime = app->frameTime;
-    int sleep = frameTime - (curtime - lasttime);
-
-    if (sleep > frameTime)
-    {
-        RG_LOGE("Our vsync timer seems to have overflowed! (%dus)", sleep);
-    }
-    else if (sleep > 0)
-    {
-        rg_usleep(sleep);
-    }
-    else if (sleep < -(frameTime / 2))
-    {
-        skipFrames++;
-    }
-
-    rg_system_tick(curtime - prevtime);
-
-    prevtime = rg_system_timer();
-    lasttime += frameTime;
-
-    if ((lasttime + frameTime) < prevtime)
-        lasttime = prevtime;
-
-    drawFrame = (skipFrames == 0);
+    // Our audio runs in its own task so the scheduler has to pace us
+    rg_system_frame_end();
+    drawFrame = rg_system_frame_begin();
 }
 
 void osd_input_read(uint8_t joypads[8])
@@ -175,6 +135,26 @@ static bool load_state_handler(const char *filename)
     return true;
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen(buffer, size, "wb");
+    bool success = fp && SaveStateFile(fp) == 0;
+    size_t used = rg_emu_state_fclose(fp);
+    return success ? used : 0;
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen((void *)buffer, size, "rb");
+    if (!fp)
+        return false;
+    bool success = LoadStateFile(fp) == 0;
+    rg_emu_state_fclose(fp);
+    if (!success)
+        ResetPCE(false);
+    return success;
+}
+
 static bool reset_handler(bool hard)
 {
     ResetPCE(hard);
@@ -192,6 +172,8 @@ void pce_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
         .reset = &reset_handler,
         .screenshot = &screenshot_handler,
         .event = &event_handler,
@@ -245,8 +227,10 @@ void pce_main(void)
 
     rg_system_set_tick_rate(60);
     app->frameskip = 1;
+    app->timerPacing = true;
 
     emulationPaused = false;
+    drawFrame = rg_system_frame_begin();
     RunPCE();
 
     RG_PANIC("PCE-GO died.");
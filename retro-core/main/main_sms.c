@@ -59,6 +59,28 @@ static bool load_state_handler(const char *filename)
     return false;
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen(buffer, size, "wb");
+    if (fp)
+        system_save_state(fp);
+    return rg_emu_state_fclose(fp);
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen((void *)buffer, size, "rb");
+    if (!fp)
+        return false;
+    system_load_state(fp);
+    // system_load_state doesn't check anything, a truncated buffer is the only thing we can catch
+    bool success = !feof(fp) && !ferror(fp);
+    rg_emu_state_fclose(fp);
+    if (!success)
+        system_reset();
+    return success;
+}
+
 static bool reset_handler(bool hard)
 {
     system_reset();
@@ -104,6 +126,8 @@ void sms_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
         .reset = &reset_handler,
         .screenshot = &screenshot_handler,
         .event = &event_handler,
@@ -165,7 +189,6 @@ void sms_main(void)
     rg_system_set_tick_rate((sms.display == DISPLAY_NTSC) ? FPS_NTSC : FPS_PAL);
     app->frameskip = 0;
 
-    int skipFrames = 0;
     int colecoKey = 0;
     int colecoKeyDecay = 0;
 
@@ -181,9 +204,7 @@ void sms_main(void)
                 rg_gui_options_menu();
         }
 
-        int64_t startTime = rg_system_timer();
-        bool drawFrame = !skipFrames;
-        bool slowFrame = false;
+        bool drawFrame = rg_system_frame_begin();
 
         input.pad[0] = 0x00;
         input.pad[1] = 0x00;
@@ -245,14 +266,16 @@ void sms_main(void)
 
         if (drawFrame)
         {
+            rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
             if (render_copy_palette(currentUpdate->palette))
                 memcpy(updates[currentUpdate == updates[0]]->palette, currentUpdate->palette, 512);
-            slowFrame = !rg_display_sync(false);
             rg_display_submit(currentUpdate, 0);
             currentUpdate = updates[currentUpdate == updates[0]]; // Swap
             bitmap.data = currentUpdate->data;
         }
 
+        rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
+
         // The emulator's sound buffer isn't in a very convenient format, we must remix it.
         size_t sample_count = snd.sample_count;
         rg_audio_sample_t mixbuffer[sample_count];
@@ -262,26 +285,9 @@ void sms_main(void)
             mixbuffer[i].right = snd.stream[1][i] * 2.75f;
         }
 
-        // Tick before submitting audio/syncing
-        rg_system_tick(rg_system_timer() - startTime);
-
         // Audio is used to pace emulation :)
         rg_audio_submit(mixbuffer, sample_count);
 
-        // See if we need to skip a frame to keep up
-        if (skipFrames == 0)
-        {
-            int elapsed = rg_system_timer() - startTime;
-            if (app->frameskip > 0)
-                skipFrames = app->frameskip;
-            else if (elapsed > app->frameTime + 1500) // Allow some jitter
-                skipFrames = 1; // (elapsed / frameTime)
-            else if (drawFrame && slowFrame)
-                skipFrames = 1;
-        }
-        else if (skipFrames > 0)
-        {
-            skipFrames--;
-        }
+        rg_system_frame_end();
     }
 }
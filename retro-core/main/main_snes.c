@@ -102,6 +102,24 @@ static bool load_state_handler(const char *filename)
     return S9xLoadState(filename);
 }
 
+static size_t save_state_mem_handler(void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen(buffer, size, "wb");
+    bool success = fp && S9xSaveStateFile(fp);
+    size_t used = rg_emu_state_fclose(fp);
+    return success ? used : 0;
+}
+
+static bool load_state_mem_handler(const void *buffer, size_t size)
+{
+    FILE *fp = rg_emu_state_fopen((void *)buffer, size, "rb");
+    if (!fp)
+        return false;
+    bool success = S9xLoadStateFile(fp);
+    rg_emu_state_fclose(fp);
+    return success;
+}
+
 static bool reset_handler(bool hard)
 {
     S9xReset();
@@ -277,10 +295,12 @@ void JustifierButtons(uint32_t *justifiers)
 #ifdef USE_BLARGG_APU
 static void S9xAudioCallback(void)
 {
+    rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
     S9xFinalizeSamples();
     size_t available_samples = S9xGetSampleCount();
     S9xMixSamples((void *)audioBuffer, available_samples);
     rg_audio_submit(audioBuffer, available_samples >> 1);
+    rg_system_frame_stage(RG_FRAME_STAGE_EMULATE);
 }
 #endif
 
@@ -297,6 +317,8 @@ void snes_main(void)
     const rg_handlers_t handlers = {
         .loadState = &load_state_handler,
         .saveState = &save_state_handler,
+        .loadStateMem = &load_state_mem_handler,
+        .saveStateMem = &save_state_mem_handler,
         .reset = &reset_handler,
         .screenshot = &screenshot_handler,
         .event = &event_handler,
@@ -368,7 +390,6 @@ void snes_main(void)
 
     bool menuCancelled = false;
     bool menuPressed = false;
-    int skipFrames = 0;
 
     while (1)
     {
@@ -395,9 +416,7 @@ void snes_main(void)
             menuCancelled = true;
         }
 
-        int64_t startTime = rg_system_timer();
-        bool drawFrame = (skipFrames == 0);
-        bool slowFrame = false;
+        bool drawFrame = rg_system_frame_begin();
 
         IPPU.RenderThisFrame = drawFrame;
         GFX.Screen = currentUpdate->data;
@@ -406,37 +425,21 @@ void snes_main(void)
 
         if (drawFrame)
         {
-            slowFrame = !rg_display_sync(false);
+            rg_system_frame_stage(RG_FRAME_STAGE_PRESENT);
             rg_display_submit(currentUpdate, 0);
         }
 
     #ifndef USE_BLARGG_APU
+        rg_system_frame_stage(RG_FRAME_STAGE_AUDIO);
         if (apu_enabled && lowpass_filter)
             S9xMixSamplesLowPass((void *)audioBuffer, AUDIO_BUFFER_LENGTH << 1, AUDIO_LOW_PASS_RANGE);
         else if (apu_enabled)
             S9xMixSamples((void *)audioBuffer, AUDIO_BUFFER_LENGTH << 1);
-    #endif
 
-        rg_system_tick(rg_system_timer() - startTime);
-
-    #ifndef USE_BLARGG_APU
         if (apu_enabled)
             rg_audio_submit(audioBuffer, AUDIO_BUFFER_LENGTH);
     #endif
 
-        if (skipFrames == 0)
-        {
-            int elapsed = rg_system_timer() - startTime;
-            if (app->frameskip > 0)
-                skipFrames = app->frameskip;
-            else if (elapsed > app->frameTime + 1500) // Allow some jitter
-                skipFrames = 1; // (elapsed / frameTime)
-            else if (drawFrame && slowFrame)
-                skipFrames = 1;
-        }
-        else if (skipFrames > 0)
-        {
-            skipFrames--;
-        }
+        rg_system_frame_end();
     }
 }
@@ -132,7 +132,7 @@ def clean_app(app):
     print("Done.\n")
 
 
-def build_app(app, device_type, with_profiling=False, no_networking=False, is_release=False):
+def build_app(app, device_type, with_profiling=0, no_networking=False, is_release=False):
     # To do: clean up if any of the flags changed since last build
     print("Building app '%s'" % app)
     args = [IDF_PY, "app"]
@@ -140,7 +140,7 @@ def build_app(app, device_type, with_profiling=False, no_networking=False, is_re
     args.append(f"-DRG_PROJECT_VER={PROJECT_VER}")
     args.append(f"-DRG_BUILD_TARGET=RG_TARGET_{re.sub(r'[^A-Z0-9]', '_', device_type.upper())}")
     args.append(f"-DRG_BUILD_RELEASE={1 if is_release else 0}")
-    args.append(f"-DRG_ENABLE_PROFILING={1 if with_profiling else 0}")
+    args.append(f"-DRG_ENABLE_PROFILING={int(with_profiling)}")
     args.append(f"-DRG_ENABLE_NETWORKING={0 if no_networking else 1}")
     with open("partitions.csv", "w") as f:
         f.write("# This table isn't used, it's just needed to avoid esp-idf build failures.\n")
@@ -193,6 +193,9 @@ parser.add_argument(
 parser.add_argument(
     "--no-networking", action="store_const", const=True, help="Build without networking support"
 )
+parser.add_argument(
+    "--instrument", action="store_const", const=True, help="Profile every function call (exact counts, much slower) instead of sampling"
+)
 parser.add_argument(
     "--port", default=DEFAULT_PORT, help="Serial port to use for flash and monitor"
 )
@@ -228,7 +231,8 @@ try:
     if command in ["build", "build-fw", "build-img", "release", "run", "profile", "install"]:
         print("=== Step: Building ===\n")
         for app in apps:
-            build_app(app, args.target, command == "profile", args.no_networking, command == "release")
+            profiling = (2 if args.instrument else 1) if command == "profile" else 0
+            build_app(app, args.target, profiling, args.no_networking, command == "release")
 
     if command in ["build-fw", "release"]:
         print("=== Step: Packing ===\n")
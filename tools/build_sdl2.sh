@@ -2,6 +2,10 @@
 
 # Supported systems: Linux / MINGW32 / MINGW64
 # Required: SDL2
+#
+# Usage: tools/build_sdl2.sh                              Build launcher.exe and retro-core.exe, then run them
+#        tools/build_sdl2.sh bench <app> <rom> [frames]   Build bench.exe and run <rom> in core <app> (nes, gbc,
+#                                                         sms, pce, snes, lnx...) unthrottled, without display or sound
 
 CC="gcc"
 # BUILD_INFO="RG:$(git describe) / SDL:$(sdl2-config --version)"
@@ -11,13 +15,26 @@ SRCFILES="components/retro-go/*.c components/retro-go/drivers/audio/*.c componen
 		  components/retro-go/libs/cJSON/*.c components/retro-go/libs/lodepng/*.c components/retro-go/libs/miniz/*.c"
 LIBS="$(sdl2-config --libs) -lstdc++"
 
-echo "Cleaning..."
-rm -f launcher.exe retro-core.exe gmon.out
+OUTPUT="retro-core.exe"
 
-echo "Building launcher..."
-$CC $CFLAGS $INCLUDES -Ilauncher/main $SRCFILES launcher/main/*.c $LIBS -o launcher.exe
+if [ "$1" = "bench" ]; then
+	if [ -z "$3" ]; then
+		echo "Usage: $0 bench <app> <rom> [frames]"
+		exit 1
+	fi
+	CFLAGS="$CFLAGS -O2 -DRG_BENCHMARK_FRAMES=3000 -DRG_SCREEN_DRIVER=100 -DRG_AUDIO_USE_SDL2=0"
+	OUTPUT="bench.exe"
+	echo "Cleaning..."
+	rm -f bench.exe
+else
+	echo "Cleaning..."
+	rm -f launcher.exe retro-core.exe gmon.out
 
-echo "Building retro-core..."
+	echo "Building launcher..."
+	$CC $CFLAGS $INCLUDES -Ilauncher/main $SRCFILES launcher/main/*.c $LIBS -o launcher.exe
+fi
+
+echo "Building $OUTPUT..."
 $CC $CFLAGS $INCLUDES \
 	-Iretro-core/components/gnuboy \
 	-Iretro-core/components/gw-emulator/src \
@@ -47,7 +64,15 @@ $CC $CFLAGS $INCLUDES \
 	retro-core/main/*.c \
 	retro-core/main/*.cpp \
 	$LIBS \
-	-o retro-core.exe
+	-o $OUTPUT || exit 1
+
+if [ "$1" = "bench" ]; then
+	echo "Running $3 for ${4:-3000} frames..."
+	RG_BENCH_APP="$2" RG_BENCH_ROM="$3" RG_BENCH_FRAMES="${4:-3000}" SDL_VIDEODRIVER=dummy SDL_AUDIODRIVER=dummy \
+		./bench.exe > bench.log 2>&1
+	grep "^RGD:BENCH" bench.log || { echo "Benchmark failed, see bench.log"; exit 1; }
+	exit 0
+fi
 
 echo "Running"
 ./launcher.exe && ./retro-core.exe